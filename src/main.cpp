@@ -6,11 +6,16 @@
 #include <bfs.h>
 #include <pagerank.h>
 
+#include <atomic>
 #include <chrono>
 #include <cmath>
+#include <condition_variable>
 #include <ctime>
-#include <fstream>
+#include <deque>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <string>
@@ -18,76 +23,227 @@
 #include <utility>
 #include <vector>
 
+#include "stream/edgeList.h"
+#include "stream/updateStream.h"
 #include "thread_pool/thread_pool.h"
 #include "thread_pool_pppcsr/thread_pool_pppcsr.h"
 
 using namespace std;
 
-enum class Operation { READ, ADD, DELETE };
-
-// Reads edge list with separator
-pair<vector<tuple<Operation, int, int>>, int> read_input(string filename, Operation defaultOp) {
-  ifstream f;
-  string line;
-  f.open(filename);
-  if (!f.good()) {
-    std::cerr << "Invalid file" << std::endl;
+// Reads edge list with separator, parsed by all cores in parallel
+update_list read_input(const string &filename, Operation defaultOp) {
+  const auto start = chrono::steady_clock::now();
+  update_list edges = read_edge_list(filename, defaultOp, std::max(1u, thread::hardware_concurrency()));
+  const auto finish = chrono::steady_clock::now();
+  if (edges.max_id >= SENTINEL_FLAG) {
+    std::cerr << "Vertex id " << edges.max_id << " out of range, rebuild with PPCSR_64BIT_IDS" << std::endl;
     exit(EXIT_FAILURE);
   }
-  vector<tuple<Operation, int, int>> edges;
-  int num_nodes = 0;
-  std::size_t pos, pos2;
-  while (getline(f, line)) {
-    int src = stoi(line, &pos);
-    int target = stoi(line.substr(pos + 1), &pos2);
-
-    num_nodes = std::max(num_nodes, std::max(src, target));
-
-    Operation op = defaultOp;
-    if (pos + 1 + pos2 + 1 < line.length()) {
-      switch (line[pos + 1 + pos2 + 1]) {
-        case '1':
-          op = Operation::ADD;
-          break;
-        case '0':
-          op = Operation::DELETE;
-          break;
-        default:
-          cerr << "Invalid operation";
-      }
-    }
-    edges.emplace_back(op, src, target);
+  if (edges.invalid != 0) {
+    cerr << "Skipped " << edges.invalid << " invalid lines" << endl;
   }
-  return make_pair(edges, num_nodes);
+  cout << "Read " << edges.size() << " edges from " << filename << " in "
+       << chrono::duration_cast<chrono::milliseconds>(finish - start).count() << " ms" << endl;
+  return edges;
 }
 
 // Does insertions
 template <typename ThreadPool_t>
-void update_existing_graph(const vector<tuple<Operation, int, int>> &input, ThreadPool_t *thread_pool, int threads,
-                           int size) {
-  for (int i = 0; i < size; i++) {
-    switch (get<0>(input[i])) {
-      case Operation::ADD:
-        thread_pool->submit_add(i % threads, get<1>(input[i]), get<2>(input[i]));
-        break;
-      case Operation::DELETE:
-        thread_pool->submit_delete(i % threads, get<1>(input[i]), get<2>(input[i]));
-        break;
-      case Operation::READ:
-        cerr << "Not implemented\n";
+void update_existing_graph(const update_list &input, ThreadPool_t *thread_pool, int threads, size_t size) {
+  // the threads execute the updates while they are submitted, a full queue holds up the submission
+  thread_pool->start(threads);
+  size_t i = 0;
+  input.for_each(
+      [&](const update &u) {
+        switch (u.op) {
+          case Operation::ADD:
+            thread_pool->submit_add(i % threads, u.src, u.dest);
+            break;
+          case Operation::DELETE:
+            thread_pool->submit_delete(i % threads, u.src, u.dest);
+            break;
+          case Operation::READ:
+            cerr << "Not implemented\n";
+            break;
+        }
+        i++;
+      },
+      size);
+  thread_pool->stop();
+}
+
+// Options of the streaming mode
+struct stream_options {
+  string source;                     // file, named pipe or "-" for stdin
+  Operation default_op;              // for lines without an operation
+  size_t limit;                      // the stream is cut off after this many updates
+  vertex_t num_nodes;                // updates with a larger vertex id are dropped, the graph doesn't grow
+  int routers;                       // threads parsing chunks and submitting the updates
+  chrono::milliseconds report_interval;
+};
+
+// bytes the reader hands to a router at once, and chunks that may wait for every router
+constexpr size_t STREAM_CHUNK_SIZE = size_t(1) << 20;
+constexpr uint64_t STREAM_CHUNKS_PER_ROUTER = 4;
+// the sustained rate is averaged over this many report intervals
+constexpr size_t RATE_WINDOW = 10;
+
+double per_second(uint64_t updates, chrono::steady_clock::duration d) {
+  const double seconds = chrono::duration<double>(d).count();
+  return seconds > 0 ? updates / seconds : 0;
+}
+
+// Applies an unbounded stream of updates while it is read: a reader thread cuts the stream into chunks of whole lines,
+// router threads parse them and submit the updates to the running thread pool. Every stage blocks while the next one
+// is behind, so memory stays bounded however fast the stream is. Meanwhile the rate of executed updates is reported
+// every interval, over the last interval and over a sliding window of RATE_WINDOW intervals.
+template <typename ThreadPool_t>
+void stream_updates(const stream_options &opts, ThreadPool_t *thread_pool, int threads) {
+  vector<unique_ptr<MPSCQueue<string *>>> chunks;
+  for (int r = 0; r < opts.routers; r++) {
+    chunks.emplace_back(new MPSCQueue<string *>(STREAM_CHUNKS_PER_ROUTER));
+  }
+  atomic<uint64_t> submitted{0};
+  atomic<uint64_t> dropped{0};
+  atomic<uint64_t> invalid{0};
+  atomic<bool> cut_off{false};
+  int routers_running = opts.routers;
+  mutex routers_mutex;
+  condition_variable routers_done;
+
+  const auto start = chrono::steady_clock::now();
+  thread_pool->start(threads);
+
+  thread reader([&] {
+    ChunkReader input(opts.source, STREAM_CHUNK_SIZE);
+    for (size_t i = 0; !cut_off.load(); i++) {
+      unique_ptr<string> chunk(new string);
+      if (!input.next(*chunk)) {
         break;
+      }
+      chunks[i % opts.routers]->push(chunk.release());
+    }
+    // end of the stream
+    for (auto &queue : chunks) {
+      queue->push(nullptr);
     }
+  });
+
+  vector<thread> routers;
+  for (int r = 0; r < opts.routers; r++) {
+    routers.emplace_back([&, r] {
+      MPSCQueue<string *> &queue = *chunks[r];
+      // spreads the updates of all routers over the threads
+      size_t next_thread = r;
+      string *chunk;
+      for (;;) {
+        if (!queue.try_pop(chunk)) {
+          queue.wait([] { return false; });
+          continue;
+        }
+        if (chunk == nullptr) {
+          break;
+        }
+        unique_ptr<string> owned(chunk);
+        uint64_t routed = 0;
+        uint64_t out_of_range = 0;
+        parse_updates(
+            owned->data(), owned->data() + owned->size(), opts.default_op,
+            [&](const update &u) {
+              if (u.src >= opts.num_nodes || u.dest >= opts.num_nodes) {
+                out_of_range++;
+                return;
+              }
+              if (cut_off.load(memory_order_relaxed) || submitted.fetch_add(1) >= opts.limit) {
+                cut_off.store(true, memory_order_relaxed);
+                return;
+              }
+              const int thread_id = next_thread++ % threads;
+              if (u.op == Operation::ADD) {
+                thread_pool->submit_add(thread_id, u.src, u.dest);
+              } else {
+                thread_pool->submit_delete(thread_id, u.src, u.dest);
+              }
+              routed++;
+            },
+            [&](const string &line) {
+              if (invalid.fetch_add(1) == 0) {
+                cerr << "Invalid update: " << line << endl;
+              }
+            });
+        dropped.fetch_add(out_of_range);
+      }
+      lock_guard<mutex> lock(routers_mutex);
+      if (--routers_running == 0) {
+        routers_done.notify_one();
+      }
+    });
   }
-  thread_pool->start(threads);
+
+  // (time, executed updates) of the last RATE_WINDOW reports
+  deque<pair<chrono::steady_clock::time_point, uint64_t>> samples{{start, 0}};
+  unique_lock<mutex> lock(routers_mutex);
+  while (!routers_done.wait_for(lock, opts.report_interval, [&] { return routers_running == 0; })) {
+    const auto now = chrono::steady_clock::now();
+    const uint64_t executed = thread_pool->executed_tasks();
+    const auto &last = samples.back();
+    const auto &first = samples.front();
+    cout << "Streamed " << executed << " updates (" << min(submitted.load(), opts.limit) - executed << " queued): "
+         << static_cast<uint64_t>(per_second(executed - last.second, now - last.first)) << " updates/s over the last "
+         << chrono::duration_cast<chrono::milliseconds>(now - last.first).count() << " ms, "
+         << static_cast<uint64_t>(per_second(executed - first.second, now - first.first)) << " updates/s over the last "
+         << chrono::duration_cast<chrono::milliseconds>(now - first.first).count() << " ms" << endl;
+    samples.emplace_back(now, executed);
+    if (samples.size() > RATE_WINDOW + 1) {
+      samples.pop_front();
+    }
+  }
+  lock.unlock();
+
+  for (auto &router : routers) {
+    router.join();
+  }
+  reader.join();
   thread_pool->stop();
+  const auto finish = chrono::steady_clock::now();
+  const uint64_t executed = thread_pool->executed_tasks();
+  cout << "Stream " << (cut_off ? "cut off" : "ended") << " after " << executed << " updates, " << dropped
+       << " dropped (vertex id out of range), " << invalid << " invalid lines" << endl;
+  cout << "Sustained rate: " << static_cast<uint64_t>(per_second(executed, finish - start)) << " updates/s over "
+       << chrono::duration_cast<chrono::milliseconds>(finish - start).count() << " ms" << endl;
+}
+
+// Edges of the core graph in the form the bulk-loading constructors take
+vector<batch_edge<void>> core_graph_edges(const update_list &core_graph) {
+  vector<batch_edge<void>> edges;
+  edges.reserve(core_graph.size());
+  core_graph.for_each([&](const update &u) {
+    if (u.op == Operation::ADD) {
+      edges.push_back({u.src, u.dest, unweighted_t()});
+    }
+  });
+  return edges;
+}
+
+// Builds the thread pool and its data structure from the core graph, the time is reported like a phase of the pool
+template <typename F>
+auto load_core_graph(F build) -> decltype(build()) {
+  auto start = chrono::steady_clock::now();
+  auto thread_pool = build();
+  auto finish = chrono::steady_clock::now();
+  cout << "Core graph loaded" << endl;
+  cout << "Elapsed wall clock time: " << chrono::duration_cast<chrono::milliseconds>(finish - start).count() << endl;
+  return thread_pool;
 }
 
 template <typename ThreadPool_t>
-void execute(int threads, int size, const vector<tuple<Operation, int, int>> &core_graph,
-             const vector<tuple<Operation, int, int>> &updates, std::unique_ptr<ThreadPool_t> &thread_pool) {
-  // Load core graph
-  update_existing_graph(core_graph, thread_pool.get(), threads, core_graph.size());
+void execute(int threads, size_t size, const update_list &updates, const stream_options &stream,
+             std::unique_ptr<ThreadPool_t> &thread_pool) {
   // Do updates
+  if (!stream.source.empty()) {
+    stream_updates(stream, thread_pool.get(), threads);
+    return;
+  }
   update_existing_graph(updates, thread_pool.get(), threads, size);
 
   //    DEBUGGING CODE
@@ -110,20 +266,26 @@ enum class Version { PPCSR, PPPCSR, PPPCSRNUMA };
 
 int main(int argc, char *argv[]) {
   int threads = 8;
-  int size = 1000000;
-  int num_nodes = 0;
+  size_t size = 1000000;
+  bool size_given = false;
+  vertex_t num_nodes = 0;
   bool lock_search = true;
   bool insert = true;
   Version v = Version::PPPCSRNUMA;
   int partitions_per_domain = 1;
-  vector<tuple<Operation, int, int>> core_graph;
-  vector<tuple<Operation, int, int>> updates;
+  int rebalance_interval = 0;
+  MemoryBackend memory_backend = MemoryBackend::MALLOC;
+  Partitioning partitioning = Partitioning::RANGE;
+  update_list core_graph;
+  update_list updates;
+  stream_options stream{"", Operation::ADD, 0, 0, 1, chrono::milliseconds(1000)};
   for (int i = 1; i < argc; i++) {
     string s = string(argv[i]);
     if (s.rfind("-threads=", 0) == 0) {
       threads = stoi(s.substr(string("-threads=").length(), s.length()));
     } else if (s.rfind("-size=", 0) == 0) {
-      size = stoi(s.substr(string("-size=").length(), s.length()));
+      size = stoull(s.substr(string("-size=").length(), s.length()));
+      size_given = true;
     } else if (s.rfind("-lock_free", 0) == 0) {
       lock_search = false;
     } else if (s.rfind("-insert", 0) == 0) {
@@ -138,50 +300,82 @@ int main(int argc, char *argv[]) {
       v = Version::PPCSR;
     } else if (s.rfind("-partitions_per_domain=", 0) == 0) {
       partitions_per_domain = stoi(s.substr(string("-partitions_per_domain=").length(), s.length()));
+    } else if (s.rfind("-rebalance=", 0) == 0) {
+      rebalance_interval = stoi(s.substr(string("-rebalance=").length(), s.length()));
+    } else if (s.rfind("-memory=", 0) == 0) {
+      memory_backend = parse_memory_backend(s.substr(string("-memory=").length(), s.length()));
+    } else if (s.rfind("-partitioning=", 0) == 0) {
+      partitioning = parse_partitioning(s.substr(string("-partitioning=").length(), s.length()));
     } else if (s.rfind("-core_graph=", 0) == 0) {
       string core_graph_filename = s.substr(string("-core_graph=").length(), s.length());
-      int temp = 0;
-      std::tie(core_graph, temp) = read_input(core_graph_filename, Operation::ADD);
-      num_nodes = std::max(num_nodes, temp);
+      core_graph = read_input(core_graph_filename, Operation::ADD);
+      num_nodes = std::max(num_nodes, core_graph.max_id);
     } else if (s.rfind("-update_file=", 0) == 0) {
       string update_filename = s.substr(string("-update_file=").length(), s.length());
       cout << update_filename << endl;
-      int temp = 0;
       Operation defaultOp = Operation::ADD;
       if (!insert) {
         defaultOp = Operation::DELETE;
       }
-      std::tie(updates, temp) = read_input(update_filename, defaultOp);
-      num_nodes = std::max(num_nodes, temp);
-      size = std::min((size_t)size, updates.size());
+      updates = read_input(update_filename, defaultOp);
+      num_nodes = std::max(num_nodes, updates.max_id);
+      size = std::min(size, updates.size());
+    } else if (s.rfind("-stream=", 0) == 0) {
+      stream.source = s.substr(string("-stream=").length(), s.length());
+    } else if (s.rfind("-nodes=", 0) == 0) {
+      stream.num_nodes = stoull(s.substr(string("-nodes=").length(), s.length()));
+    } else if (s.rfind("-routers=", 0) == 0) {
+      stream.routers = std::max(1, stoi(s.substr(string("-routers=").length(), s.length())));
+    } else if (s.rfind("-report_interval=", 0) == 0) {
+      stream.report_interval =
+          chrono::milliseconds(std::max(1, stoi(s.substr(string("-report_interval=").length(), s.length()))));
     }
   }
   if (core_graph.empty()) {
     cout << "Core graph file not specified" << endl;
     exit(EXIT_FAILURE);
   }
-  if (updates.empty()) {
+  if (!stream.source.empty()) {
+    // the graph is sized up front, the stream may only refer to vertices up to -nodes
+    stream.default_op = insert ? Operation::ADD : Operation::DELETE;
+    stream.limit = size_given ? size : numeric_limits<size_t>::max();
+    num_nodes = std::max(num_nodes, stream.num_nodes == 0 ? 0 : stream.num_nodes - 1);
+    stream.num_nodes = num_nodes + 1;
+    cout << "Streaming updates from " << stream.source << " for " << stream.num_nodes << " vertices" << endl;
+  } else if (updates.empty()) {
     cout << "Updates file not specified" << endl;
     exit(EXIT_FAILURE);
   }
   cout << "Core graph size: " << core_graph.size() << endl;
+  cout << "Memory backend: " << memory_backend_name(memory_backend) << endl;
+  cout << "Partitioning: " << partitioning_name(partitioning) << endl;
   //   sort(core_graph.begin(), core_graph.end());
+  vector<batch_edge<void>> core_edges = core_graph_edges(core_graph);
+  core_graph = update_list();
   switch (v) {
     case Version::PPCSR: {
-      auto thread_pool = make_unique<ThreadPool>(threads, lock_search, num_nodes + 1, partitions_per_domain);
-      execute(threads, size, core_graph, updates, thread_pool);
+      auto thread_pool = load_core_graph([&] {
+        return make_unique<ThreadPool>(threads, lock_search, num_nodes + 1, std::move(core_edges), memory_backend);
+      });
+      execute(threads, size, updates, stream, thread_pool);
       break;
     }
     case Version::PPPCSR: {
-      auto thread_pool =
-          make_unique<ThreadPoolPPPCSR>(threads, lock_search, num_nodes + 1, partitions_per_domain, false);
-      execute(threads, size, core_graph, updates, thread_pool);
+      auto thread_pool = load_core_graph([&] {
+        return make_unique<ThreadPoolPPPCSR>(threads, lock_search, num_nodes + 1, std::move(core_edges),
+                                             partitions_per_domain, false, memory_backend, partitioning);
+      });
+      thread_pool->enable_rebalancing(chrono::milliseconds(rebalance_interval));
+      execute(threads, size, updates, stream, thread_pool);
       break;
     }
     default: {
-      auto thread_pool =
-          make_unique<ThreadPoolPPPCSR>(threads, lock_search, num_nodes + 1, partitions_per_domain, true);
-      execute(threads, size, core_graph, updates, thread_pool);
+      auto thread_pool = load_core_graph([&] {
+        return make_unique<ThreadPoolPPPCSR>(threads, lock_search, num_nodes + 1, std::move(core_edges),
+                                             partitions_per_domain, true, memory_backend, partitioning);
+      });
+      thread_pool->enable_rebalancing(chrono::milliseconds(rebalance_interval));
+      execute(threads, size, updates, stream, thread_pool);
     }
   }
 
@@ -8,14 +8,25 @@
 #include <numa.h>
 
 #include <algorithm>
+#include <climits>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <queue>
+#include <thread>
 #include <tuple>
 #include <vector>
 
+#include "futex.h"
+#include "leafScan.h"
+
 using namespace std;
 
 // find index of first 1-bit (least significant bit)
@@ -32,120 +43,469 @@ static inline T bsr_word(T word) {
   return result;
 }
 
+__extension__ typedef unsigned __int128 uint128_t;
+
+// smallest edge array the constructors create, batch removals never shrink the array below it
+constexpr uint64_t MIN_EDGE_ARRAY_SIZE = 2048;
+
+// resizes and redistributions hand out at least this many slots to every thread working on them
+constexpr uint64_t PARALLEL_SLOTS_PER_WORKER = uint64_t(1) << 16;
+
+// first rank r with floor(r * len / total) >= offset: spreading total elements evenly over len slots puts the
+// elements of rank >= first_rank_at(offset) at or after slot offset
+static inline uint64_t first_rank_at(uint64_t offset, uint64_t total, uint64_t len) {
+  const uint128_t product = uint128_t(offset) * total;
+  return std::min<uint64_t>(total, product / len + (product % len != 0));
+}
+
+// Slot offsets floor(r * len / total) of consecutive ranks r of an even spread, stepped exactly as quotient and
+// remainder so neither rounding nor overflow can occur
+struct spread_cursor {
+  uint64_t pos;
+  uint64_t rem;
+  uint64_t step;
+  uint64_t step_rem;
+  uint64_t total;
+
+  spread_cursor(uint64_t rank, uint64_t total, uint64_t len) : step(len / total), step_rem(len % total), total(total) {
+    const uint128_t product = uint128_t(rank) * len;
+    pos = product / total;
+    rem = product % total;
+  }
+
+  void next() {
+    pos += step;
+    rem += step_rem;
+    if (rem >= total) {
+      rem -= total;
+      pos++;
+    }
+  }
+};
+
+// Reusable barrier for the threads of one parallel redistribution. The phases in between are short, so waiting
+// threads spin for a moment before they sleep on a futex.
+class WorkerBarrier {
+ public:
+  explicit WorkerBarrier(index_t workers) : workers(workers), arrived{0}, generation{0} {}
+
+  void wait() {
+    const uint32_t gen = generation.load();
+    if (arrived.fetch_add(1) + 1 == workers) {
+      arrived.store(0);
+      generation.fetch_add(1);
+      futex_wake(&generation, INT_MAX);
+      return;
+    }
+    for (unsigned spins = 0; generation.load() == gen; spins++) {
+      if (spins >= 128) {
+        futex_wait(&generation, gen);
+      }
+    }
+  }
+
+ private:
+  const index_t workers;
+  std::atomic<index_t> arrived;
+  std::atomic<uint32_t> generation;
+};
+
+// number of CPUs of a NUMA domain, of the machine if domain < 0
+static index_t count_domain_cpus(int domain) {
+  index_t cpus = thread::hardware_concurrency();
+  if (domain >= 0) {
+    struct bitmask *mask = numa_allocate_cpumask();
+    if (numa_node_to_cpus(domain, mask) == 0) {
+      cpus = numa_bitmask_weight(mask);
+    }
+    numa_free_cpumask(mask);
+  }
+  return std::max<index_t>(cpus, 4);
+}
+
+// Helper threads of a NUMA domain (of the machine if domain < 0), shared by the PCSRs on it. They are started when a
+// job needs them and sleep on a futex between jobs. One job runs at a time.
+class DomainPool {
+ public:
+  static DomainPool &of(int domain) {
+    static mutex pools_mutex;
+    static map<int, unique_ptr<DomainPool>> pools;
+    const lock_guard<mutex> lck(pools_mutex);
+    unique_ptr<DomainPool> &pool = pools[domain];
+    if (!pool) {
+      pool.reset(new DomainPool(domain));
+    }
+    return *pool;
+  }
+
+  ~DomainPool() {
+    stopping.store(true);
+    job_generation.fetch_add(1);
+    futex_wake(&job_generation, INT_MAX);
+    for (thread &helper : helpers) {
+      helper.join();
+    }
+  }
+
+  // Runs job(w) for every w in [0, workers), worker 0 on the calling thread. Returns false without running anything
+  // if another job is running.
+  bool try_run(index_t workers, const function<void(index_t)> &job) {
+    unique_lock<mutex> lck(running, try_to_lock);
+    if (!lck.owns_lock()) {
+      return false;
+    }
+    while (helpers.size() + 1 < workers) {
+      const index_t id = helpers.size() + 1;
+      helpers.emplace_back([this, id, seen = job_generation.load()] { work(id, seen); });
+    }
+    current_job = &job;
+    job_workers = workers;
+    // every helper acknowledges every job, so none of them can miss one
+    pending.store(helpers.size());
+    job_generation.fetch_add(1);
+    futex_wake(&job_generation, INT_MAX);
+    job(0);
+    for (uint32_t left = pending.load(); left != 0; left = pending.load()) {
+      futex_wait(&pending, left);
+    }
+    return true;
+  }
+
+ private:
+  explicit DomainPool(int domain) : domain(domain), stopping{false}, job_generation{0}, pending{0} {}
+
+  void work(index_t id, uint32_t seen) {
+    if (domain >= 0) {
+      numa_run_on_node(domain);
+    }
+    for (;;) {
+      while (job_generation.load() == seen) {
+        futex_wait(&job_generation, seen);
+      }
+      seen++;
+      if (stopping.load()) {
+        return;
+      }
+      if (id < job_workers) {
+        (*current_job)(id);
+      }
+      if (pending.fetch_sub(1) == 1) {
+        futex_wake(&pending, 1);
+      }
+    }
+  }
+
+  const int domain;
+  mutex running;  // held by the thread whose job runs
+  vector<thread> helpers;
+  const function<void(index_t)> *current_job = nullptr;
+  index_t job_workers = 0;
+  atomic<bool> stopping;
+  // bumped for every job, the helpers sleep on it
+  atomic<uint32_t> job_generation;
+  // helpers that haven't finished the current job, the thread that runs it sleeps on it
+  atomic<uint32_t> pending;
+};
+
+// Runs fn(w) for every w in [0, workers): worker 0 on the calling thread, the others on helper threads that run on
+// the CPUs of the given NUMA domain (anywhere if domain < 0). These come from the domain's pool, if the pool is busy
+// with the job of another PCSR they are started for this job alone.
+template <typename F>
+static void run_workers(index_t workers, int domain, F fn) {
+  if (workers == 1) {
+    fn(0);
+    return;
+  }
+  if (DomainPool::of(domain).try_run(workers, [&fn](index_t w) { fn(w); })) {
+    return;
+  }
+  vector<thread> helpers;
+  helpers.reserve(workers - 1);
+  for (index_t w = 1; w < workers; w++) {
+    helpers.emplace_back([&fn, w, domain] {
+      if (domain >= 0) {
+        numa_run_on_node(domain);
+      }
+      fn(w);
+    });
+  }
+  fn(0);
+  for (auto &helper : helpers) {
+    helper.join();
+  }
+}
+
+// Sorts items stably with workers threads: every worker sorts a chunk, then neighbouring runs are merged pairwise
+template <typename T, typename Compare>
+static void parallel_stable_sort(vector<T> &items, index_t workers, int domain, Compare comp) {
+  const size_t n = items.size();
+  auto bound = [&](size_t w) { return n * std::min<size_t>(w, workers) / workers; };
+  run_workers(workers, domain, [&](index_t w) {
+    std::stable_sort(items.begin() + bound(w), items.begin() + bound(w + 1), comp);
+  });
+  if (workers == 1) {
+    return;
+  }
+  vector<T> merged(n);
+  for (size_t width = 1; width < workers; width *= 2) {
+    run_workers((workers + 2 * width - 1) / (2 * width), domain, [&](index_t m) {
+      const size_t lo = bound(2 * width * m);
+      const size_t mid = bound(2 * width * m + width);
+      const size_t hi = bound(2 * width * (m + 1));
+      std::merge(items.begin() + lo, items.begin() + mid, items.begin() + mid, items.begin() + hi, merged.begin() + lo,
+                 comp);
+    });
+    items.swap(merged);
+  }
+}
+
 typedef struct _pair_double {
   double x;
   double y;
 } pair_double;
 
-void PCSR::nodes_unlock_shared(bool unlock, int start_node, int end_node) {
+template <typename value_t>
+void PCSR<value_t>::nodes_unlock_shared(bool unlock, index_t start_node, index_t end_node) {
   if (unlock) {
-    for (int i = start_node; i <= end_node; i++) {
-      edges.node_locks[i]->unlock_shared();
+    for (index_t i = start_node; i <= end_node; i++) {
+      edges.node_locks[i].unlock_shared();
     }
   }
 }
 
+template <typename value_t>
+void EdgeValues<value_t>::allocate(size_t count, const EdgeArrayAllocator &allocator) {
+  data = allocator.allocate<value_t>(count);
+}
+
+template <typename value_t>
+void EdgeValues<value_t>::reallocate(size_t old_count, size_t new_count, const EdgeArrayAllocator &allocator) {
+  data = allocator.reallocate(data, old_count, new_count);
+}
+
+template <typename value_t>
+void EdgeValues<value_t>::release(size_t count, const EdgeArrayAllocator &allocator) {
+  allocator.release(data, count);
+}
+
+// weight of an edge in arithmetic, edges of unweighted graphs count as 1
 template <typename T>
-void checkAllocation(T *ptr) {
-  if (ptr == NULL) {
-    cout << "Allocation failed. Abort\n";
-    exit(EXIT_FAILURE);
-  }
+T edge_weight(T value) {
+  return value;
+}
+
+uint32_t edge_weight(unweighted_t) { return 1; }
+
+template <typename T>
+void print_value(T value) {
+  cout << ", " << value;
 }
 
+void print_value(unweighted_t) {}
+
 // same as find_leaf, but does it for any level in the tree
 // index: index in array
 // len: length of sub-level.
-int find_node(int index, int len) { return (index / len) * len; }
+index_t find_node(index_t index, index_t len) { return (index / len) * len; }
+
+// number of PCSR leaves, which is also the position of the first leaf in the count tree
+index_t leaf_count(const edge_list_t *list) { return list->N / list->logN; }
+
+// constructs the leaf locks [from, to) in the allocated lock array
+void construct_locks(edge_list_t *list, index_t from, index_t to) {
+  for (index_t i = from; i < to; i++) {
+    new (&list->node_locks[i]) leaf_lock_t();
+  }
+}
 
-// null overrides sentinel
-// e.g. in rebalance, we check if an edge is null
-// first before copying it into temp, then fix the sentinels.
-bool is_sentinel(const edge_t &e) { return e.dest == UINT32_MAX || e.value == UINT32_MAX; }
+// adds delta to the count of the leaf holding slot index and to all its ancestors
+void add_to_count(edge_list_t *list, index_t index, int delta) {
+  for (index_t k = leaf_count(list) + (index >> bsf_word(list->logN)); k > 0; k >>= 1) {
+    list->counts[k].fetch_add(static_cast<index_t>(delta), std::memory_order_relaxed);
+  }
+}
+
+// recomputes the inner nodes of the subtree spanning num_leaves leaves (a power of two) from first_leaf on, which
+// must be aligned to num_leaves. Nodes above the subtree are left alone.
+void update_subtree(edge_list_t *list, index_t first_leaf, index_t num_leaves) {
+  index_t k = leaf_count(list) + first_leaf;
+  for (index_t width = num_leaves / 2; width > 0; width /= 2) {
+    k /= 2;
+    for (index_t i = k; i < k + width; i++) {
+      list->counts[i].store(list->counts[2 * i].load(std::memory_order_relaxed) +
+                                list->counts[2 * i + 1].load(std::memory_order_relaxed),
+                            std::memory_order_relaxed);
+    }
+  }
+}
 
-// bool is_null(edge_t e) { return e.value == 0; }
+// number of occupied slots in [index, index + len), O(log N) as whole leaves are read from the count tree
+index_t occupied_slots(edge_list_t *list, index_t index, index_t len) {
+  const index_t logN = list->logN;
+  const int shift = bsf_word(logN);
+  const index_t end = index + len;
+  // whole leaves in the range
+  index_t first = (index + logN - 1) >> shift;
+  index_t last = end >> shift;
+  index_t full = 0;
+  if (first >= last) {
+    for (auto i = index; i < end; i++) {
+      full += (!is_null(list->dests[i]));
+    }
+    return full;
+  }
+  for (auto i = index; i < first * logN; i++) {
+    full += (!is_null(list->dests[i]));
+  }
+  for (auto i = last * logN; i < end; i++) {
+    full += (!is_null(list->dests[i]));
+  }
+  const index_t leaves = leaf_count(list);
+  for (first += leaves, last += leaves; first < last; first /= 2, last /= 2) {
+    if (first & 1) {
+      full += list->counts[first++].load(std::memory_order_relaxed);
+    }
+    if (last & 1) {
+      full += list->counts[--last].load(std::memory_order_relaxed);
+    }
+  }
+  return full;
+}
 
-void PCSR::resizeEdgeArray(size_t newSize) {
+// recounts the occupied slots of every leaf in the window [index, index + len) of whole leaves
+void recount_leaves(edge_list_t *list, index_t index, index_t len) {
+  const index_t leaves = leaf_count(list);
+  for (index_t leaf = index / list->logN; leaf < (index + len) / list->logN; leaf++) {
+    index_t full = 0;
+    for (index_t i = leaf * list->logN; i < (leaf + 1) * list->logN; i++) {
+      full += (!is_null(list->dests[i]));
+    }
+    list->counts[leaves + leaf].store(full, std::memory_order_relaxed);
+  }
+  update_subtree(list, index / list->logN, len / list->logN);
+}
+
+template <typename value_t>
+void PCSR<value_t>::resizeEdgeArray(size_t newSize) {
+  if (newSize - 1 > std::numeric_limits<index_t>::max()) {
+    cout << "Edge array of " << newSize << " slots exceeds the index range, rebuild with PPCSR_64BIT_IDS. Abort\n";
+    exit(EXIT_FAILURE);
+  }
   edges.N = newSize;
   edges.logN = (1 << bsr_word(bsr_word(edges.N) * 2 + 1));
   edges.H = bsr_word(edges.N / edges.logN);
   std::cout << "Edges: " << edges.N << " logN: " << edges.logN << " #count: " << edges.N / edges.logN << std::endl;
 }
 
-void PCSR::clear() {
-  if (is_numa_available) {
-    numa_free(edges.items, edges.N * sizeof(*(edges.items)));
-  } else {
-    free(edges.items);
-  }
+template <typename value_t>
+void PCSR<value_t>::clear() {
+  allocator.release(edges.dests, edges.N);
+  allocator.release(edges.counts, 2 * leaf_count(&edges));
+  values.release(edges.N, allocator);
   resizeEdgeArray(2 << bsr_word(0));
 }
 
-vector<tuple<uint32_t, uint32_t, uint32_t>> PCSR::get_edges() {
+template <typename value_t>
+vector<tuple<vertex_t, vertex_t, typename PCSR<value_t>::value_type>> PCSR<value_t>::get_edges() {
   const auto n = get_n();
-  vector<tuple<uint32_t, uint32_t, uint32_t>> output;
+  vector<tuple<vertex_t, vertex_t, value_type>> output;
 
   for (uint64_t i = 0; i < n; i++) {
     auto start = nodes[i].beginning;
     auto end = nodes[i].end;
     for (auto j = start + 1; j < end; j++) {
-      if (!is_null(edges.items[j].value)) {
-        output.push_back(make_tuple(i, edges.items[j].dest, edges.items[j].value));
+      if (!is_null(edges.dests[j])) {
+        output.push_back(make_tuple(i, edges.dests[j], values.get(j)));
       }
     }
   }
   return output;
 }
 
-uint64_t PCSR::get_n() const { return nodes.size(); }
+template <typename value_t>
+uint64_t PCSR<value_t>::get_n() const { return nodes.size(); }
 
-uint64_t PCSR::get_size() {
+template <typename value_t>
+uint64_t PCSR<value_t>::get_size() {
   uint64_t size = nodes.capacity() * sizeof(node_t);
-  size += edges.N * sizeof(edge_t);
+  size += edges.N * (sizeof(*edges.dests) + values.slot_size);
+  size += 2 * leaf_count(&edges) * sizeof(*edges.counts);
+  size += leaf_count(&edges) * sizeof(*edges.node_locks);
   return size;
 }
 
-void PCSR::print_array() {
+template <typename value_t>
+void PCSR<value_t>::print_array() {
   for (uint64_t i = 0; i < edges.N; i++) {
-    if (is_null(edges.items[i].value)) {
+    if (is_null(edges.dests[i])) {
       cout << i << "-x ";
-    } else if (is_sentinel(edges.items[i])) {
-      uint32_t value = edges.items[i].value;
-      if (value == UINT32_MAX) {
-        value = 0;
-      }
-      printf("\n%d-s(%u):(%d, %d) ", i, value, nodes[value].beginning, nodes[value].end);
+    } else if (is_sentinel(edges.dests[i])) {
+      const vertex_t id = sentinel_id(edges.dests[i]);
+      cout << "\n" << i << "-s(" << id << "):(" << nodes[id].beginning << ", " << nodes[id].end << ") ";
     } else {
-      printf("%d-(%d, %u) ", i, edges.items[i].dest, edges.items[i].value);
+      cout << i << "-(" << edges.dests[i];
+      print_value(values.get(i));
+      cout << ") ";
     }
   }
-  printf("\n\n");
+  cout << "\n\n";
 }
 
-// get density of a node
-double get_density(edge_list_t *list, int index, int len) {
-  int full = 0;
-  for (auto i = index; i < index + len; i++) {
-    full += (!is_null(list->items[i].value));
+// mask of the lowest len bits
+inline uint64_t low_bits(size_t len) { return (len < 64) ? (uint64_t(1) << len) - 1 : ~uint64_t(0); }
+
+// first empty slot in [index, N), N if there is none
+uint64_t next_empty(edge_list_t *list, uint64_t index) {
+  for (uint64_t i = index; i < list->N; i += LEAF_SCAN_MAX_LEN) {
+    const size_t len = std::min<uint64_t>(LEAF_SCAN_MAX_LEN, list->N - i);
+    const uint64_t empty = ~scan_leaf(list->dests + i, len, 0).occupied & low_bits(len);
+    if (empty != 0) {
+      return i + __builtin_ctzll(empty);
+    }
   }
-  const auto full_d = static_cast<double>(full);
-  return full_d / len;
+  return list->N;
 }
 
-double get_full(edge_list_t *list, int index, int len) {
-  int full = 0;
-  for (int i = 0; i < index + len; i++) {
-    full += (!is_null(list->items[i].value));
+// last empty slot in [0, index), -1 if there is none
+int64_t prev_empty(edge_list_t *list, int64_t index) {
+  for (int64_t i = index; i > 0; i -= LEAF_SCAN_MAX_LEN) {
+    const int64_t begin = std::max<int64_t>(0, i - LEAF_SCAN_MAX_LEN);
+    const uint64_t empty = ~scan_leaf(list->dests + begin, i - begin, 0).occupied & low_bits(i - begin);
+    if (empty != 0) {
+      return begin + 63 - __builtin_clzll(empty);
+    }
   }
-  return static_cast<double>(full);
+  return -1;
+}
+
+// last occupied slot in [0, index], -1 if there is none
+int64_t prev_occupied(edge_list_t *list, int64_t index) {
+  for (int64_t i = index + 1; i > 0; i -= LEAF_SCAN_MAX_LEN) {
+    const int64_t begin = std::max<int64_t>(0, i - LEAF_SCAN_MAX_LEN);
+    const uint64_t occupied = scan_leaf(list->dests + begin, i - begin, 0).occupied;
+    if (occupied != 0) {
+      return begin + 63 - __builtin_clzll(occupied);
+    }
+  }
+  return -1;
+}
+
+// get density of a node
+double get_density(edge_list_t *list, index_t index, index_t len) {
+  const auto full_d = static_cast<double>(occupied_slots(list, index, len));
+  return full_d / len;
+}
+
+double get_full(edge_list_t *list, index_t index, index_t len) {
+  return static_cast<double>(occupied_slots(list, 0, index + len));
 }
 
 // height of this node in the tree
-int get_depth(edge_list_t *list, int len) { return bsr_word(list->N / len); }
+int get_depth(edge_list_t *list, index_t len) { return bsr_word(list->N / len); }
 
 // get parent of this node in the tree
-pair<int, int> get_parent(edge_list_t *list, int index, int len) {
-  int parent_len = len * 2;
+pair<index_t, int> get_parent(edge_list_t *list, index_t index, index_t len) {
+  index_t parent_len = len * 2;
   int depth = get_depth(list, len);
 
   return make_pair(parent_len, depth);
@@ -165,15 +525,14 @@ pair_double density_bound(edge_list_t *list, int depth) {
 }
 
 // fix pointer from node to moved sentinel
-void PCSR::fix_sentinel(const edge_t &sentinel, int in) {
+template <typename value_t>
+void PCSR<value_t>::fix_sentinel(vertex_t sentinel, index_t in) {
   if (!is_sentinel(sentinel)) {
     return;
   }
-  auto node_index = sentinel.value;
+  auto node_index = sentinel_id(sentinel);
 
-  if (node_index == UINT32_MAX) {
-    node_index = 0;
-  } else {
+  if (node_index > 0) {
     nodes[node_index - 1].end = in;
   }
   nodes[node_index].beginning = in;
@@ -219,202 +578,400 @@ void PCSR::fix_sentinel(const edge_t &sentinel, int in) {
 //}
 
 // Inplace version
-void PCSR::redistribute(int index, int len) {
+template <typename value_t>
+void PCSR<value_t>::redistribute(index_t index, index_t len) {
+  const index_t workers = parallel_workers(len);
+  if (workers > 1) {
+    redistribute_parallel(index, len, workers);
+    return;
+  }
   size_t j = 0;
-  const size_t end = index + len;
-
-  for (size_t i = index; i < end; i++) {
-    edges.items[index + j] = edges.items[i];
-    // counting non-null edges
-    j += (!is_null(edges.items[index + j].value));
+  const size_t end = size_t(index) + len;
+
+  // compact the elements to the front of the window, the occupancy masks of the scan skip the empty slots
+  for (size_t i = index; i < end; i += LEAF_SCAN_MAX_LEN) {
+    const size_t chunk = std::min(LEAF_SCAN_MAX_LEN, end - i);
+    for (uint64_t occupied = scan_leaf(edges.dests + i, chunk, 0).occupied; occupied != 0; occupied &= occupied - 1) {
+      const size_t from = i + __builtin_ctzll(occupied);
+      edges.dests[index + j] = edges.dests[from];
+      values.move(index + j, from);
+      j++;
+    }
   }
-  for (size_t i = index + j; i < end; i++) {
-    edges.items[i].src = -1;
-    edges.items[i].value = 0;
-    edges.items[i].dest = 0;
+  std::fill(edges.dests + index + j, edges.dests + end, NULL_DEST);
+
+  // leaf occupancy follows from the target positions, which are handed out from the last leaf of the window down
+  const index_t leaves = leaf_count(&edges);
+  const index_t first_leaf = index / edges.logN;
+  index_t leaf = (end - 1) / edges.logN;
+  size_t leaf_begin = size_t(leaf) * edges.logN;
+  index_t occupied = 0;
+  auto count_slot = [&](size_t in) {
+    for (; in < leaf_begin; leaf--, leaf_begin -= edges.logN) {
+      edges.counts[leaves + leaf].store(occupied, std::memory_order_relaxed);
+      occupied = 0;
+    }
+    occupied++;
+  };
+  // sentinels whose node already points at their slot stay untouched
+  auto place_sentinel = [&](size_t in) {
+    const vertex_t dest = edges.dests[in];
+    if (is_sentinel(dest) && nodes[sentinel_id(dest)].beginning != in) {
+      fix_sentinel(dest, in);
+    }
+  };
+
+  if (j > 0) {
+    // evenly redistribute for a uniform density, element i goes to offset floor(i * len / j). The offsets are stepped
+    // down exactly as quotient and remainder of len / j, so no floating point rounding and no overflow can occur.
+    const size_t q = len / j;
+    const int64_t r = len % j;
+    size_t offset = len;
+    int64_t rem = 0;
+
+    // Ignore element at position index since it is already in the correct position
+    for (size_t i = j - 1; i > 0; i--) {
+      offset -= q;
+      rem -= r;
+      if (rem < 0) {
+        rem += j;
+        offset--;
+      }
+      const size_t in = index + offset;
+      const size_t from = index + i;
+      if (in != from) {
+        edges.dests[in] = edges.dests[from];
+        values.move(in, from);
+        edges.dests[from] = NULL_DEST;
+      }
+      place_sentinel(in);
+      count_slot(in);
+    }
+    place_sentinel(index);
+    count_slot(index);
+  }
+  // flush the leaf of the last placed element and the empty leaves in front of it
+  for (;; leaf--, occupied = 0) {
+    edges.counts[leaves + leaf].store(occupied, std::memory_order_relaxed);
+    if (leaf == first_leaf) {
+      break;
+    }
   }
-  // evenly redistribute for a uniform density
-  const double step = static_cast<double>(len) / j;
-  double index_d = index + static_cast<double>(j - 1) * step;
+  // the window keeps its total, so only the inner nodes below its root change
+  update_subtree(&edges, first_leaf, len / edges.logN);
+}
 
-  // Ignore element at position index since it is already in the correct position
-  for (auto i = index + j - 1; i > index; i--) {
-    const size_t in = static_cast<size_t>(index_d);
+template <typename value_t>
+index_t PCSR<value_t>::parallel_workers(uint64_t len) const {
+  return std::max<index_t>(1, std::min<uint64_t>(domain_cpus, len / PARALLEL_SLOTS_PER_WORKER));
+}
 
-    std::swap(edges.items[in], edges.items[i]);
-    fix_sentinel(edges.items[in], in);
-    index_d -= step;
-  }
-  fix_sentinel(edges.items[index], index);
+// Every worker owns a range of whole leaves of the window. The workers first add up the leaf counts of their range,
+// then compact their elements into a shared buffer at their prefix offset, and finally spread the elements that land
+// in their range back. Only the last phase writes slots other workers read, so two barriers suffice.
+template <typename value_t>
+void PCSR<value_t>::redistribute_parallel(index_t index, index_t len, index_t workers) {
+  const index_t leaves = leaf_count(&edges);
+  const index_t first_leaf = index / edges.logN;
+  const index_t num_leaves = len / edges.logN;
+  auto part = [&](index_t w) -> index_t { return first_leaf + uint64_t(num_leaves) * w / workers; };
+
+  vector<uint64_t> offset(workers + 1, 0);
+  vector<edge_t> space;
+  WorkerBarrier barrier(workers);
+  run_workers(workers, is_numa_available ? domain : -1, [&](index_t w) {
+    // parallel prefix count over the leaf counts
+    uint64_t sum = 0;
+    for (index_t leaf = part(w); leaf < part(w + 1); leaf++) {
+      sum += edges.counts[leaves + leaf].load(std::memory_order_relaxed);
+    }
+    offset[w + 1] = sum;
+    barrier.wait();
+    if (w == 0) {
+      for (index_t i = 0; i < workers; i++) {
+        offset[i + 1] += offset[i];
+      }
+      space.resize(offset[workers]);
+    }
+    barrier.wait();
+    const index_t begin = part(w) * edges.logN;
+    const index_t end = part(w + 1) * edges.logN;
+    redistr_store(space.data() + offset[w], begin, end - begin);
+    barrier.wait();
+
+    // parallel scatter of the ranks that land in [begin, end)
+    const uint64_t total = offset[workers];
+    for (index_t i = part(w); i < part(w + 1); i++) {
+      edges.counts[leaves + i].store(0, std::memory_order_relaxed);
+    }
+    if (total == 0) {
+      return;
+    }
+    uint64_t rank = first_rank_at(begin - index, total, len);
+    const uint64_t last_rank = first_rank_at(end - index, total, len);
+    index_t leaf = part(w);
+    index_t occupied = 0;
+    for (spread_cursor cursor(rank, total, len); rank < last_rank; rank++, cursor.next()) {
+      const index_t in = index + cursor.pos;
+      if (in / edges.logN != leaf) {
+        edges.counts[leaves + leaf].store(occupied, std::memory_order_relaxed);
+        leaf = in / edges.logN;
+        occupied = 0;
+      }
+      edges.dests[in] = space[rank].dest;
+      values.set(in, space[rank].value);
+      fix_sentinel(space[rank].dest, in);
+      occupied++;
+    }
+    if (occupied > 0) {
+      edges.counts[leaves + leaf].store(occupied, std::memory_order_relaxed);
+    }
+  });
+  update_subtree(&edges, first_leaf, num_leaves);
 }
 
-void PCSR::double_list() {
-  const int prev_locks_size = edges.N / edges.logN;
-  resizeEdgeArray(edges.N * 2);
-  const int new_locks_size = edges.N / edges.logN;
+template <typename value_t>
+void PCSR<value_t>::merge_window(index_t index, index_t len, const index_t *after, const edge_t *items, size_t count,
+                                 vector<edge_t> &space) {
+  const size_t end = size_t(index) + len;
+
+  // gather the old elements and the new ones behind the element they follow
+  space.clear();
+  size_t k = 0;
+  for (size_t i = index; i < end; i += LEAF_SCAN_MAX_LEN) {
+    const size_t chunk = std::min(LEAF_SCAN_MAX_LEN, end - i);
+    for (uint64_t occupied = scan_leaf(edges.dests + i, chunk, 0).occupied; occupied != 0; occupied &= occupied - 1) {
+      const size_t from = i + __builtin_ctzll(occupied);
+      space.push_back({edges.dests[from], values.get(from)});
+      for (; k < count && after[k] == from; k++) {
+        space.push_back(items[k]);
+      }
+    }
+  }
+  std::fill(edges.dests + index, edges.dests + end, NULL_DEST);
 
-  // Added by Eleni Alevra - START
-  if (is_numa_available) {
-    edges.node_locks = (HybridLock **)numa_realloc(edges.node_locks, prev_locks_size * sizeof(HybridLock *),
-                                                   new_locks_size * sizeof(HybridLock *));
-    checkAllocation(edges.node_locks);
-  } else {
-    edges.node_locks = (HybridLock **)realloc(edges.node_locks, new_locks_size * sizeof(HybridLock *));
+  const index_t leaves = leaf_count(&edges);
+  const index_t first_leaf = index / edges.logN;
+  const index_t num_leaves = len / edges.logN;
+  for (index_t leaf = first_leaf; leaf < first_leaf + num_leaves; leaf++) {
+    edges.counts[leaves + leaf].store(0, std::memory_order_relaxed);
   }
-  for (int i = prev_locks_size; i < new_locks_size; i++) {
-    edges.node_locks[i] = new HybridLock();
+  spread_cursor cursor(0, space.size(), len);
+  for (size_t r = 0; r < space.size(); r++, cursor.next()) {
+    const index_t in = index + cursor.pos;
+    edges.dests[in] = space[r].dest;
+    values.set(in, space[r].value);
+    fix_sentinel(space[r].dest, in);
+    edges.counts[leaves + in / edges.logN].fetch_add(1, std::memory_order_relaxed);
   }
-  // Added by Eleni Alevra - END
-
-  if (is_numa_available) {
-    edges.items =
-        (edge_t *)numa_realloc(edges.items, (edges.N / 2) * sizeof(*(edges.items)), edges.N * sizeof(*(edges.items)));
-  } else {
-    edges.items = (edge_t *)realloc(edges.items, edges.N * sizeof(*(edges.items)));
+  update_subtree(&edges, first_leaf, num_leaves);
+  // the nodes above the window have not seen the new elements yet
+  for (index_t node = (leaves + first_leaf) / num_leaves / 2; node > 0; node /= 2) {
+    edges.counts[node].fetch_add(count, std::memory_order_relaxed);
   }
+}
+
+template <typename value_t>
+void PCSR<value_t>::rebuild(uint64_t new_size) {
+  rebuild(new_size, splice_t());
+}
 
-  for (int i = edges.N / 2; i < edges.N; i++) {
-    edges.items[i].value = 0;  // setting second half to null
-    edges.items[i].dest = 0;   // setting second half to null
+template <typename value_t>
+void PCSR<value_t>::rebuild(uint64_t new_size, const splice_t &splice) {
+  const edge_list_t old = edges;
+  const index_t prev_locks_size = leaf_count(&old);
+  EdgeValues<value_t> old_values = values;
+
+  // rank of the first element of every old leaf, read from the count tree
+  vector<index_t> first_rank(prev_locks_size + 1, 0);
+  for (index_t i = 0; i < prev_locks_size; i++) {
+    first_rank[i + 1] = first_rank[i] + old.counts[prev_locks_size + i].load(std::memory_order_relaxed);
   }
+  // ranks [0, front) are spliced in front, [front, kept_end) are the kept old elements and the rest is spliced behind
+  const uint64_t front = splice.front.size();
+  const uint64_t kept_end = front + first_rank[prev_locks_size] - splice.drop_front - splice.drop_back;
+  const uint64_t total = kept_end + splice.back.size();
 
-  redistribute(0, edges.N);
-}
+  resizeEdgeArray(new_size);
+  const index_t new_locks_size = leaf_count(&edges);
 
-void PCSR::half_list() {
-  const int prev_locks_size = edges.N / edges.logN;
-  resizeEdgeArray(edges.N / 2);
-  const int new_locks_size = edges.N / edges.logN;
+  // Added by Eleni Alevra - START
+  // the locks the caller holds keep their state when the array moves
+  edges.node_locks = allocator.reallocate(edges.node_locks, prev_locks_size, new_locks_size);
+  construct_locks(&edges, prev_locks_size, new_locks_size);
+  // Added by Eleni Alevra - END
 
-  int j = 0;
-  for (int i = 0; i < edges.N * 2; i++) {
-    if (!is_null(edges.items[i].value)) {
-      edges.items[j++] = edges.items[i];
+  edges.dests = allocator.allocate<vertex_t>(edges.N);
+  edges.counts = allocator.allocate<std::atomic<index_t>>(2 * new_locks_size);
+  values.allocate(edges.N, allocator);
+
+  // Element of rank r goes to slot floor(r * N / total), the same even spread redistribute produces. Every worker fills
+  // a range of whole new leaves, so it writes its own slots and leaf counts only. Sentinels of different nodes touch
+  // different fields of nodes.
+  const index_t workers = parallel_workers(edges.N);
+  run_workers(workers, is_numa_available ? domain : -1, [&](index_t w) {
+    const index_t first_leaf = uint64_t(new_locks_size) * w / workers;
+    const index_t last_leaf = uint64_t(new_locks_size) * (w + 1) / workers;
+    const uint64_t begin = uint64_t(first_leaf) * edges.logN;
+    const uint64_t end = uint64_t(last_leaf) * edges.logN;
+    std::fill(edges.dests + begin, edges.dests + end, NULL_DEST);
+    for (index_t leaf = first_leaf; leaf < last_leaf; leaf++) {
+      edges.counts[new_locks_size + leaf].store(0, std::memory_order_relaxed);
+    }
+    if (total == 0) {
+      return;
+    }
+    // ranks [rank, last_rank) land in [begin, end)
+    uint64_t rank = first_rank_at(begin, total, edges.N);
+    const uint64_t last_rank = first_rank_at(end, total, edges.N);
+    if (rank >= last_rank) {
+      return;
+    }
+    spread_cursor cursor(rank, total, edges.N);
+
+    index_t leaf = cursor.pos / edges.logN;
+    index_t occupied = 0;
+    // writes the element of rank rank to its slot and returns the slot
+    auto place = [&](vertex_t dest) {
+      const uint64_t pos = cursor.pos;
+      if (pos / edges.logN != leaf) {
+        edges.counts[new_locks_size + leaf].store(occupied, std::memory_order_relaxed);
+        leaf = pos / edges.logN;
+        occupied = 0;
+      }
+      edges.dests[pos] = dest;
+      fix_sentinel(dest, pos);
+      occupied++;
+      return pos;
+    };
+
+    for (; rank < std::min(last_rank, front); rank++, cursor.next()) {
+      values.set(place(splice.front[rank].dest), splice.front[rank].value);
     }
-  }
-  // set remaining elements to null
-  for (; j < edges.N; j++) {
-    edges.items[j].value = 0;
-    edges.items[j].dest = 0;
-  }
 
-  for (int i = new_locks_size; i < prev_locks_size; i++) {
-    edges.node_locks[i]->unlock();
-    delete edges.node_locks[i];
-  }
+    const uint64_t kept_last = std::min(last_rank, kept_end);
+    if (rank < kept_last) {
+      // old slot of the element of rank rank
+      const uint64_t old_rank = rank - front + splice.drop_front;
+      const index_t old_leaf = upper_bound(first_rank.begin(), first_rank.end(), old_rank) - first_rank.begin() - 1;
+      uint64_t from = uint64_t(old_leaf) * old.logN;
+      for (index_t skip = old_rank - first_rank[old_leaf]; skip > 0 || is_null(old.dests[from]); from++) {
+        skip -= !is_null(old.dests[from]);
+      }
 
-  if (is_numa_available) {
-    edges.node_locks = (HybridLock **)numa_realloc(edges.node_locks, prev_locks_size * sizeof(HybridLock *),
-                                                   new_locks_size * sizeof(HybridLock *));
-    checkAllocation(edges.node_locks);
-    edges.items =
-        (edge_t *)numa_realloc(edges.items, edges.N * 2 * sizeof(*(edges.items)), edges.N * sizeof(*(edges.items)));
+      for (uint64_t i = from - from % LEAF_SCAN_MAX_LEN; rank < kept_last; i += LEAF_SCAN_MAX_LEN) {
+        const size_t chunk = std::min<uint64_t>(LEAF_SCAN_MAX_LEN, old.N - i);
+        uint64_t mask = scan_leaf(old.dests + i, chunk, 0).occupied;
+        if (i < from) {
+          mask &= ~0ULL << (from - i);
+        }
+        for (; mask != 0 && rank < kept_last; mask &= mask - 1, rank++, cursor.next()) {
+          const uint64_t slot = i + __builtin_ctzll(mask);
+          vertex_t dest = old.dests[slot];
+          if (splice.id_shift != 0 && is_sentinel(dest)) {
+            dest = SENTINEL_FLAG | (sentinel_id(dest) + splice.id_shift);
+          }
+          values.copy(place(dest), old_values, slot);
+        }
+      }
+    }
 
-    checkAllocation(edges.items);
-  } else {
-    edges.node_locks = (HybridLock **)realloc(edges.node_locks, new_locks_size * sizeof(HybridLock *));
-    edges.items = (edge_t *)realloc(edges.items, edges.N * sizeof(*(edges.items)));
+    for (; rank < last_rank; rank++, cursor.next()) {
+      const edge_t &elem = splice.back[rank - kept_end];
+      values.set(place(elem.dest), elem.value);
+    }
+    edges.counts[new_locks_size + leaf].store(occupied, std::memory_order_relaxed);
+  });
+  update_subtree(&edges, 0, new_locks_size);
+  // the last node always reaches the end of the array, even if it has no sentinel in the new array yet
+  if (!nodes.empty()) {
+    nodes.back().end = edges.N - 1;
   }
 
-  redistribute(0, edges.N);
+  allocator.release(old.dests, old.N);
+  allocator.release(old.counts, 2 * prev_locks_size);
+  old_values.release(old.N, allocator);
+}
+
+template <typename value_t>
+void PCSR<value_t>::double_list() {
+  rebuild(edges.N * 2);
+}
+
+template <typename value_t>
+void PCSR<value_t>::half_list() {
+  rebuild(edges.N / 2);
 }
 
 // index is the beginning of the sequence that you want to slide right.
 // notice that slide right does not not null the current spot.
 // this is ok because we will be putting something in the current index
 // after sliding everything to the right.
-int PCSR::slide_right(int index, uint32_t src) {
-  int rval = 0;
-  edge_t el = edges.items[index];
-  edges.items[index].src = -1;
-  edges.items[index].dest = 0;
-  edges.items[index].value = 0;
-  index++;
-  while (index < edges.N && !is_null(edges.items[index].value)) {
-    edge_t temp = edges.items[index];
-    edges.items[index] = el;
-    if (!is_null(el.value)) {
-      // fixing pointer of node that goes to this sentinel
-      fix_sentinel(el, index);
-    }
-    el = temp;
-    index++;
-  }
-  if (!is_null(el.value)) {
+// The whole run up to the next empty slot moves at once. If there is no empty slot to the right nothing moves and
+// -1 is returned, the caller has to make room on the left instead.
+template <typename value_t>
+int PCSR<value_t>::slide_right(index_t index, vertex_t src) {
+  (void)src;
+  const uint64_t empty = next_empty(&edges, index);
+  if (empty == edges.N) {
+    cout << "slide off the end on the right, should be rare\n";
+    return -1;
+  }
+  const size_t count = empty - index;
+  memmove(edges.dests + index + 1, edges.dests + index, count * sizeof(*edges.dests));
+  values.move_range(index + 1, index, count);
+  edges.dests[index] = NULL_DEST;
+  for (uint64_t i = index + 1; i <= empty; i++) {
     // fixing pointer of node that goes to this sentinel
-    fix_sentinel(el, index);
+    fix_sentinel(edges.dests[i], i);
   }
-  if (index == edges.N) {
-    index--;
-    slide_left(index, src);
-    rval = -1;
-    printf("slide off the end on the right, should be rare\n");
-  }
-  edges.items[index] = el;
-  return rval;
+  add_to_count(&edges, index, -1);
+  add_to_count(&edges, empty, 1);
+  return 0;
 }
 
 // only called in slide right if it was going to go off the edge
 // since it can't be full this doesn't need to worry about going off the other
 // end
-void PCSR::slide_left(int index, uint32_t src) {
-  edge_t el = edges.items[index];
-  edges.items[index].src = -1;
-  edges.items[index].dest = 0;
-  edges.items[index].value = 0;
-
-  index--;
-  while (index >= 0 && !is_null(edges.items[index].value)) {
-    edge_t temp = edges.items[index];
-    edges.items[index] = el;
-    if (!is_null(el.value)) {
+template <typename value_t>
+void PCSR<value_t>::slide_left(int64_t index, vertex_t src) {
+  const int64_t empty = prev_empty(&edges, index);
+  if (empty >= 0) {
+    const size_t count = index - empty;
+    memmove(edges.dests + empty, edges.dests + empty + 1, count * sizeof(*edges.dests));
+    values.move_range(empty, empty + 1, count);
+    edges.dests[index] = NULL_DEST;
+    for (int64_t i = empty; i < index; i++) {
       // fixing pointer of node that goes to this sentinel
-      fix_sentinel(el, index);
+      fix_sentinel(edges.dests[i], i);
     }
-    el = temp;
-    index--;
-  }
-
-  if (index == -1) {
-    double_list();
-
-    slide_right(0, src);
-    index = 0;
-  }
-  if (!is_null(el.value)) {
-    // fixing pointer of node that goes to this sentinel
-    fix_sentinel(el, index);
+    add_to_count(&edges, index, -1);
+    add_to_count(&edges, empty, 1);
+    return;
   }
-
-  edges.items[index] = el;
+  // the array is full up to index: shift the run left, take the first element out, double the array and put the
+  // element back in front
+  const vertex_t el_dest = edges.dests[0];
+  const value_type el_value = values.get(0);
+  memmove(edges.dests, edges.dests + 1, index * sizeof(*edges.dests));
+  values.move_range(0, 1, index);
+  edges.dests[index] = NULL_DEST;
+  add_to_count(&edges, index, -1);
+  for (int64_t i = 0; i < index; i++) {
+    fix_sentinel(edges.dests[i], i);
+  }
+
+  double_list();
+  slide_right(0, src);
+
+  edges.dests[0] = el_dest;
+  values.set(0, el_value);
+  fix_sentinel(el_dest, 0);
+  add_to_count(&edges, 0, 1);
 }
 
 // given index, return the starting index of the leaf it is in
-int find_leaf(edge_list_t *list, int index) { return (index / list->logN) * list->logN; }
-
-// true if e1, e2 are equals
-bool edge_equals(const edge_t &e1, const edge_t &e2) { return e1.dest == e2.dest && e1.value == e2.value; }
-
-// return index of the edge elem
-// takes in edge list and place to start looking
-uint32_t find_elem_pointer(edge_list_t *list, uint32_t index, edge_t elem) {
-  edge_t item = list->items[index];
-  while (!edge_equals(item, elem)) {
-    item = list->items[++index];
-  }
-  return index;
-}
-
-// return index of the edge elem
-// takes in edge list and place to start looking
-// looks in reverse
-uint32_t find_elem_pointer_reverse(edge_list_t *list, uint32_t index, edge_t elem) {
-  edge_t item = list->items[index];
-  while (!edge_equals(item, elem)) {
-    item = list->items[--index];
-  }
-  return index;
-}
+index_t find_leaf(edge_list_t *list, index_t index) { return (index / list->logN) * list->logN; }
 
 // important: make sure start, end don't include sentinels
 // returns the index of the smallest element bigger than you in the range
@@ -424,29 +981,47 @@ uint32_t find_elem_pointer_reverse(edge_list_t *list, uint32_t index, edge_t ele
 // this is to check if it has changed when we lock to do the insertion
 // This function was modified for Eleni Alevra's implementation to return the version number and to do
 // unlocking when unlock is set
-pair<uint32_t, int> PCSR::binary_search(edge_t *elem, uint32_t start, uint32_t end, bool unlock) {
+template <typename value_t>
+pair<index_t, int> PCSR<value_t>::binary_search(edge_t *elem, index_t start, index_t end, bool unlock) {
   int ins_v = -1;
-  uint32_t start_node = find_leaf(&edges, start) / edges.logN;
-  uint32_t end_node = find_leaf(&edges, end) / edges.logN;
+  const index_t start_node = find_leaf(&edges, start) / edges.logN;
+  const index_t end_node = find_leaf(&edges, end) / edges.logN;
 
   while (start + 1 < end) {
-    // TODO: fix potential overflow for large data sets (use std::midpoint)
-    const uint32_t mid = (start + end) / 2;
+    if (end - start <= index_t(edges.logN)) {
+      // the window fits into a leaf, compare all slots at once instead of skipping nulls slot by slot
+      const leaf_masks m = scan_leaf(edges.dests + start, end - start, elem->dest);
+      const uint64_t greater_eq = m.occupied & ~m.less;
+      // slot after the last smaller element, it is either empty or holds the first larger one
+      const index_t after_less = (m.less != 0) ? start + 64 - __builtin_clzll(m.less) : start;
+      index_t pos;
+      if (greater_eq != 0) {
+        const index_t first = start + __builtin_ctzll(greater_eq);
+        pos = (edges.dests[first] == elem->dest) ? first : after_less;
+      } else {
+        // end of the last node is no sentinel and may hold a smaller edge, return end as the scalar search does
+        pos = is_sentinel(edges.dests[end]) ? after_less : end;
+      }
+      ins_v = edges.node_locks[find_leaf(&edges, pos) / edges.logN].load();
+      nodes_unlock_shared(unlock, start_node, end_node);
+      return make_pair(pos, ins_v);
+    }
+    const index_t mid = start + (end - start) / 2;
     //    elems++;
-    edge_t item = edges.items[mid];
-    uint32_t change = 1;
-    uint32_t check = mid;
+    vertex_t item = edges.dests[mid];
+    index_t change = 1;
+    index_t check = mid;
 
     bool flag = true;
-    while (is_null(item.value) && flag) {
+    while (is_null(item) && flag) {
       flag = false;
       check = mid + change;
       if (check < end) {
         flag = true;
         if (check <= end) {
           //          elems++;
-          item = edges.items[check];
-          if (!is_null(item.value) || check == end) {
+          item = edges.dests[check];
+          if (!is_null(item) || check == end) {
             break;
           }
         }
@@ -455,16 +1030,16 @@ pair<uint32_t, int> PCSR::binary_search(edge_t *elem, uint32_t start, uint32_t e
       if (check >= start) {
         flag = true;
         //        elems++;
-        item = edges.items[check];
+        item = edges.dests[check];
       }
       change++;
     }
 
-    ins_v = edges.node_locks[find_leaf(&edges, check) / edges.logN]->load();
-    int ins2 = edges.node_locks[find_leaf(&edges, mid) / edges.logN]->load();
-    if (is_null(item.value) || start == check || end == check) {
+    ins_v = edges.node_locks[find_leaf(&edges, check) / edges.logN].load();
+    int ins2 = edges.node_locks[find_leaf(&edges, mid) / edges.logN].load();
+    if (is_null(item) || start == check || end == check) {
       nodes_unlock_shared(unlock, start_node, end_node);
-      if (!is_null(item.value) && start == check && elem->dest <= item.dest) {
+      if (!is_null(item) && start == check && elem->dest <= item) {
         return make_pair(check, ins_v);
       } else {
         return make_pair(mid, ins2);
@@ -472,11 +1047,11 @@ pair<uint32_t, int> PCSR::binary_search(edge_t *elem, uint32_t start, uint32_t e
     }
 
     // if we found it, return
-    ins_v = edges.node_locks[find_leaf(&edges, check) / edges.logN]->load();
-    if (elem->dest == item.dest) {
+    ins_v = edges.node_locks[find_leaf(&edges, check) / edges.logN].load();
+    if (elem->dest == item) {
       nodes_unlock_shared(unlock, start_node, end_node);
       return make_pair(check, ins_v);
-    } else if (elem->dest < item.dest) {
+    } else if (elem->dest < item) {
       end = check;  // if the searched for item is less than current item, set end
     } else {
       start = check;
@@ -490,44 +1065,46 @@ pair<uint32_t, int> PCSR::binary_search(edge_t *elem, uint32_t start, uint32_t e
   // if you are leq, return start (index where elt is)
   // otherwise, return end (no element greater than you in the range)
   // printf("start = %d, end = %d, n = %d\n", start,end, list->N);
-  ins_v = edges.node_locks[find_leaf(&edges, start) / edges.logN]->load();
-  if (elem->dest <= edges.items[start].dest && !is_null(edges.items[start].value)) {
+  ins_v = edges.node_locks[find_leaf(&edges, start) / edges.logN].load();
+  if (elem->dest <= edges.dests[start] && !is_null(edges.dests[start])) {
     nodes_unlock_shared(unlock, start_node, end_node);
     return make_pair(start, ins_v);
   }
-  ins_v = edges.node_locks[find_leaf(&edges, end) / edges.logN]->load();
+  ins_v = edges.node_locks[find_leaf(&edges, end) / edges.logN].load();
   nodes_unlock_shared(unlock, start_node, end_node);
   // Could also be null but it's end
   return make_pair(end, ins_v);
 }
 
-uint32_t PCSR::find_value(uint32_t src, uint32_t dest) {
+template <typename value_t>
+typename PCSR<value_t>::value_type PCSR<value_t>::find_value(vertex_t src, vertex_t dest) {
   edge_t e;
-  e.value = 0;
+  e.value = value_type();
   e.dest = dest;
   auto bs = binary_search(&e, nodes[src].beginning + 1, nodes[src].end, false);
   auto loc = bs.first;
-  if (!is_null(edges.items[loc].value) && edges.items[loc].dest == dest) {
-    return edges.items[loc].value;
+  if (!is_null(edges.dests[loc]) && edges.dests[loc] == dest) {
+    return values.get(loc);
   } else {
-    return 0;
+    return value_type();
   }
 }
 
 // insert elem at index returns index that the element went to (which
 // may not be the same one that you put it at)
-void PCSR::insert(uint32_t index, edge_t elem, uint32_t src, insertion_info_t *info) {
+template <typename value_t>
+void PCSR<value_t>::insert(index_t index, edge_t elem, vertex_t src, insertion_info_t *info) {
   auto node_index = find_leaf(&edges, index);
   auto level = edges.H;
-  auto len = edges.logN;
+  index_t len = edges.logN;
 
   // always deposit on the left
-  if (!is_null(edges.items[index].value)) {
+  if (!is_null(edges.dests[index])) {
     // if the edge already exists in the graph, update its value
     // do not make another edge
     // return index of the edge that already exists
-    if (!is_sentinel(elem) && edges.items[index].dest == elem.dest) {
-      edges.items[index].value = elem.value;
+    if (!is_sentinel(elem.dest) && edges.dests[index] == elem.dest) {
+      values.set(index, elem.value);
       return;
     }
     if (index == edges.N - 1) {
@@ -545,9 +1122,9 @@ void PCSR::insert(uint32_t index, edge_t elem, uint32_t src, insertion_info_t *i
       }
     }
   }
-  edges.items[index].src = elem.src;
-  edges.items[index].value = elem.value;
-  edges.items[index].dest = elem.dest;
+  edges.dests[index] = elem.dest;
+  values.set(index, elem.value);
+  add_to_count(&edges, index, 1);
 
   auto density = get_density(&edges, node_index, len);
 
@@ -589,21 +1166,22 @@ void PCSR::insert(uint32_t index, edge_t elem, uint32_t src, insertion_info_t *i
       }
     }
   }
-  if (len > edges.logN) {
+  if (len > index_t(edges.logN)) {
     redistribute(node_index, len);
   }
 }
 
-void PCSR::remove(uint32_t index, const edge_t &elem, uint32_t src) {
+template <typename value_t>
+void PCSR<value_t>::remove(index_t index, const edge_t &elem, vertex_t src) {
   auto node_index = find_leaf(&edges, index);
   auto level = edges.H;
-  auto len = edges.logN;
+  index_t len = edges.logN;
 
-  if (is_null(edges.items[index].value) || is_sentinel(elem) || edges.items[index].dest != elem.dest) {
+  if (is_null(edges.dests[index]) || is_sentinel(elem.dest) || edges.dests[index] != elem.dest) {
     return;
   } else {
-    edges.items[index].value = 0;
-    edges.items[index].dest = 0;
+    edges.dests[index] = NULL_DEST;
+    add_to_count(&edges, index, -1);
   }
 
   redistribute(node_index, len);
@@ -629,14 +1207,8 @@ void PCSR::remove(uint32_t index, const edge_t &elem, uint32_t src) {
   redistribute(node_index, len);
 }
 
-// find index of edge
-uint32_t find_index(edge_list_t *list, edge_t *elem_pointer) {
-  edge_t *array_start = list->items;
-  uint32_t index = (elem_pointer - array_start);
-  return index;
-}
-
-std::vector<uint32_t> PCSR::sparse_matrix_vector_multiplication(std::vector<uint32_t> const &v) {
+template <typename value_t>
+std::vector<uint32_t> PCSR<value_t>::sparse_matrix_vector_multiplication(std::vector<uint32_t> const &v) {
   std::vector<uint32_t> result(nodes.size(), 0);
 
   auto num_vertices = nodes.size();
@@ -644,24 +1216,27 @@ std::vector<uint32_t> PCSR::sparse_matrix_vector_multiplication(std::vector<uint
   for (size_t i = 0; i < num_vertices; i++) {
     // +1 to avoid sentinel
 
-    for (uint32_t j = nodes[i].beginning + 1; j < nodes[i].end; j++) {
-      result[i] += edges.items[j].value * v[edges.items[j].dest];
+    for (index_t j = nodes[i].beginning + 1; j < nodes[i].end; j++) {
+      if (!is_null(edges.dests[j])) {
+        result[i] += edge_weight(values.get(j)) * v[edges.dests[j]];
+      }
     }
   }
   return result;
 }
 
 // Prints neighbours of vertex src
-void PCSR::print_graph(int src) {
-  int num_vertices = nodes.size();
-  for (int i = 0; i < num_vertices; i++) {
+template <typename value_t>
+void PCSR<value_t>::print_graph(vertex_t src) {
+  const vertex_t num_vertices = nodes.size();
+  for (vertex_t i = 0; i < num_vertices; i++) {
     // +1 to avoid sentinel
     //    int matrix_index = 0;
     if (i != src) continue;
 
-    for (uint32_t j = nodes[i].beginning + 1; j < nodes[i].end; j++) {
-      if (!is_null(edges.items[j].value)) {
-        printf("%d ", edges.items[j].dest);
+    for (index_t j = nodes[i].beginning + 1; j < nodes[i].end; j++) {
+      if (!is_null(edges.dests[j])) {
+        cout << edges.dests[j] << " ";
         //        while (matrix_index < edges.items[j].dest) {
         //          printf("000 ");
         //          matrix_index++;
@@ -673,19 +1248,26 @@ void PCSR::print_graph(int src) {
     //    for (uint32_t j = matrix_index; j < num_vertices; j++) {
     //      printf("000 ");
     //    }
-    printf("\n");
+    cout << "\n";
   }
 }
 
 // add a node to the graph
-void PCSR::add_node() {
+template <typename value_t>
+vertex_t PCSR<value_t>::add_node() {
+  const std::lock_guard<FastLock> lck(*edges.global_lock);
+  if (!free_nodes.empty()) {
+    // the sentinel of a removed node is still in place
+    const vertex_t id = free_nodes.back();
+    free_nodes.pop_back();
+    return id;
+  }
   adding_sentinels = true;
   node_t node;
   auto len = nodes.size();
   edge_t sentinel;
-  sentinel.src = len;
-  sentinel.dest = UINT32_MAX;  // placeholder
-  sentinel.value = len;        // back pointer
+  sentinel.dest = SENTINEL_FLAG | len;  // back pointer
+  sentinel.value = value_type();
 
   if (len > 0) {
     node.beginning = nodes[len - 1].end;
@@ -693,24 +1275,26 @@ void PCSR::add_node() {
   } else {
     node.beginning = 0;
     node.end = 1;
-    sentinel.value = UINT32_MAX;
   }
   node.num_neighbors = 0;
 
   nodes.push_back(node);
   insert(node.beginning, sentinel, nodes.size() - 1, nullptr);
+  nodes.back().end = edges.N - 1;
   adding_sentinels = false;
+  return len;
 }
 
 // This function was re-written for Eleni Alevra's implementation
-void PCSR::add_edge(uint32_t src, uint32_t dest, uint32_t value) { add_edge_parallel(src, dest, value, 0); }
+template <typename value_t>
+void PCSR<value_t>::add_edge(vertex_t src, vertex_t dest, value_type value) { add_edge_parallel(src, dest, value, 0); }
 
 // Added by me
-void PCSR::remove_edge(uint32_t src, uint32_t dest) {
+template <typename value_t>
+void PCSR<value_t>::remove_edge(vertex_t src, vertex_t dest) {
   edge_t e;
-  e.src = src;
   e.dest = dest;
-  e.value = 1;
+  e.value = value_type();
 
   edges.global_lock->lock_shared();
 
@@ -718,14 +1302,14 @@ void PCSR::remove_edge(uint32_t src, uint32_t dest) {
   auto end = nodes[src].end;
   auto first_node = get_node_id(find_leaf(&edges, beginning + 1));
   auto last_node = get_node_id(find_leaf(&edges, end));
-  uint32_t loc_to_rem;
+  index_t loc_to_rem;
   int ins_node_v;
   if (lock_bsearch) {
     for (auto i = first_node; i <= last_node; i++) {
-      edges.node_locks[i]->lock_shared();
+      edges.node_locks[i].lock_shared();
     }
     if (nodes[src].beginning != beginning || nodes[src].end != end) {
-      release_locks_no_inc(make_pair(first_node, last_node));
+      nodes_unlock_shared(true, first_node, last_node);
       edges.global_lock->unlock_shared();
       remove_edge(src, dest);
       return;
@@ -734,9 +1318,9 @@ void PCSR::remove_edge(uint32_t src, uint32_t dest) {
     // Keep the version number of the PCSR node we will remove from so that if by the time we lock it has changed we
     // can re-start. We can't keep the PCSR node locked after binary search in case we have to acquire some locks to
     // its left first.
-    ins_node_v = edges.node_locks[get_node_id(find_leaf(&edges, loc_to_rem))]->load();
+    ins_node_v = edges.node_locks[get_node_id(find_leaf(&edges, loc_to_rem))].load();
     for (auto i = first_node; i <= last_node; i++) {
-      edges.node_locks[i]->unlock_shared();
+      edges.node_locks[i].unlock_shared();
     }
   } else {
     auto bs = binary_search(&e, nodes[src].beginning + 1, nodes[src].end, false);
@@ -746,10 +1330,17 @@ void PCSR::remove_edge(uint32_t src, uint32_t dest) {
 
   nodes[src].num_neighbors--;
 
-  auto acquired_locks = acquire_remove_locks(loc_to_rem, e, src, ins_node_v, -1);
+  auto acquired_locks = acquire_remove_locks(loc_to_rem, e, src, ins_node_v, NO_NODE_BOUND);
   if (acquired_locks.first == EDGE_NOT_FOUND) {
-    cout << "not found " << src << " " << dest << endl;
+    nodes[src].num_neighbors++;
     edges.global_lock->unlock_shared();
+    // the neighbours left of the search position were read without locks and may have been on the move, a validated
+    // read tells whether the edge is really missing
+    if (edge_exists(src, dest)) {
+      remove_edge(src, dest);
+    } else {
+      cout << "not found " << src << " " << dest << endl;
+    }
     return;
   }
   if (acquired_locks.first == NEED_GLOBAL_WRITE) {
@@ -772,39 +1363,35 @@ void PCSR::remove_edge(uint32_t src, uint32_t dest) {
   }
 }
 
-PCSR::PCSR(uint32_t init_n, uint32_t src_n, bool lock_search, int domain)
-    : nodes(src_n), is_numa_available{numa_available() >= 0 && domain >= 0}, domain(domain) {
-  resizeEdgeArray(2 << bsr_word(std::max(init_n + src_n, 1024u)));
+template <typename value_t>
+PCSR<value_t>::PCSR(vertex_t init_n, vertex_t src_n, bool lock_search, int domain, MemoryBackend memory_backend)
+    : nodes(src_n),
+      is_numa_available{numa_available() >= 0 && domain >= 0},
+      domain(domain),
+      allocator(memory_backend, is_numa_available ? domain : -1),
+      domain_cpus(count_domain_cpus(is_numa_available ? domain : -1)) {
+  resizeEdgeArray(uint64_t(2) << bsr_word(std::max<uint64_t>(uint64_t(init_n) + src_n, 1024)));
   edges.global_lock = make_shared<FastLock>();
 
   lock_bsearch = lock_search;
-  if (is_numa_available) {
-    edges.node_locks = (HybridLock **)numa_alloc_onnode((edges.N / edges.logN) * sizeof(HybridLock *), domain);
-    checkAllocation(edges.node_locks);
-
-    edges.items = (edge_t *)numa_alloc_onnode(edges.N * sizeof(*(edges.items)), domain);
-    checkAllocation(edges.items);
-  } else {
-    edges.node_locks = (HybridLock **)malloc((edges.N / edges.logN) * sizeof(HybridLock *));
-    edges.items = (edge_t *)malloc(edges.N * sizeof(*(edges.items)));
-  }
-
-  for (uint32_t i = 0; i < edges.N / edges.logN; i++) {
-    edges.node_locks[i] = new HybridLock();
-  }
+  edges.node_locks = allocator.allocate<leaf_lock_t>(leaf_count(&edges));
+  construct_locks(&edges, 0, leaf_count(&edges));
+  edges.dests = allocator.allocate<vertex_t>(edges.N);
+  edges.counts = allocator.allocate<std::atomic<index_t>>(2 * leaf_count(&edges));
+  values.allocate(edges.N, allocator);
 
   double index_d = 0.0;
   const double step = ((double)edges.N) / src_n;
-  int in = 0;
+  index_t in = 0;
 
-  for (uint32_t i = 0; i < src_n; i++) {
+  for (vertex_t i = 0; i < src_n; i++) {
     if (i == 0) {
       nodes[i].beginning = 0;
     } else {
       nodes[i].beginning = nodes[i - 1].end;
     }
     index_d += step;
-    in = static_cast<int>(index_d);
+    in = static_cast<index_t>(index_d);
     nodes[i].end = in;
     nodes[i].num_neighbors = 0;
   }
@@ -814,73 +1401,106 @@ PCSR::PCSR(uint32_t init_n, uint32_t src_n, bool lock_search, int domain)
 
   index_d = 0.0;
   in = 0;
-  int current = 0;
+  vertex_t current = 0;
 
   // evenly distribute for a uniform density
-  for (int i = 0; i < edges.N; i++) {
+  for (uint64_t i = 0; i < edges.N; i++) {
     if (i == in && current < src_n) {
-      edges.items[i].src = current;
-      edges.items[i].dest = UINT32_MAX;  // placeholder
-      if (i == 0) {
-        edges.items[i].value = UINT32_MAX;
-      } else {
-        edges.items[i].value = current;  // back pointer
-      }
+      edges.dests[i] = SENTINEL_FLAG | current;  // back pointer
       current++;
       index_d += step;
-      in = static_cast<int>(index_d);
+      in = static_cast<index_t>(index_d);
     } else {
-      edges.items[i].src = -1;
-      edges.items[i].dest = 0;
-      edges.items[i].value = 0;
+      edges.dests[i] = NULL_DEST;
     }
   }
+  recount_leaves(&edges, 0, edges.N);
 }
 
-PCSR::~PCSR() {
-  for (uint32_t i = 0; i < (edges.N / edges.logN); i++) {
-    delete edges.node_locks[i];
-  }
-  if (is_numa_available) {
-    numa_free(edges.node_locks, (edges.N / edges.logN) * sizeof(HybridLock *));
-    numa_free(edges.items, edges.N * sizeof(*(edges.items)));
-  } else {
-    free(edges.node_locks);
-    free(edges.items);
-  }
+template <typename value_t>
+PCSR<value_t>::~PCSR() {
+  allocator.release(edges.node_locks, leaf_count(&edges));
+  allocator.release(edges.dests, edges.N);
+  allocator.release(edges.counts, 2 * leaf_count(&edges));
+  values.release(edges.N, allocator);
 }
 
 /**
  * The following functions were all added for Eleni Alevra's implementation.
  */
 
-// Used for debugging
+// Seqlock-style read: the sequence numbers of the leaves from the sentinel of src to the one of the next node are
+// summed up before and after read runs. Writers bump the sequence number of every leaf they lock twice, so the sums
+// only match if no writer held one of the leaves in between. Readers never write to the leaf locks. The reads between
+// the two sums race with writers, they load atomically and their result is only used once the sums match.
+// The reader has to be registered with the global lock, lock_shared doesn't hold off resizes otherwise.
+template <typename value_t>
+template <typename F>
+void PCSR<value_t>::read_optimistically(vertex_t src, F read) const {
+  if (src >= get_n()) {
+    return;
+  }
+  for (;;) {
+    // safe point for resizes, which replace the edge array and the leaf locks
+    edges.global_lock->lock_shared();
+    const index_t beginning = load_relaxed(nodes[src].beginning);
+    const index_t end = load_relaxed(nodes[src].end);
+    const index_t first_leaf = get_node_id(beginning);
+    const index_t last_leaf = get_node_id(end);
+    uint64_t before = 0;
+    // a range torn by a concurrent move of the sentinels isn't read at all
+    bool writing = beginning >= end || end >= edges.N;
+    for (index_t leaf = first_leaf; !writing && leaf <= last_leaf; leaf++) {
+      const unsigned sequence = edges.node_locks[leaf].read_begin();
+      writing |= (sequence & 1) != 0;
+      before += sequence;
+    }
+    // the range is only valid if src didn't move before the sequence numbers were taken
+    if (!writing && load_relaxed(nodes[src].beginning) == beginning && load_relaxed(nodes[src].end) == end) {
+      read(beginning, end);
+      uint64_t after = 0;
+      for (index_t leaf = first_leaf; leaf <= last_leaf; leaf++) {
+        after += edges.node_locks[leaf].read_end();
+      }
+      if (after == before) {
+        edges.global_lock->unlock_shared();
+        return;
+      }
+    }
+    edges.global_lock->unlock_shared();
+    std::this_thread::yield();
+  }
+}
+
 // Returns true if edge {src, dest} exists
 // Added by Eleni Alevra
-bool PCSR::edge_exists(uint32_t src, uint32_t dest) {
-  node_t node = nodes[src];
-
+template <typename value_t>
+bool PCSR<value_t>::edge_exists(vertex_t src, vertex_t dest) {
   edge_t e;
   e.dest = dest;
-  e.value = 1;
-  auto loc_to_rem = binary_search(&e, node.beginning + 1, node.end, false).first;
-  e = edges.items[loc_to_rem];
-  return !(is_null(e.value)) && !is_sentinel(e) && e.dest == dest;
+  e.value = value_type();
+  bool exists = false;
+  read_optimistically(src, [&](index_t beginning, index_t end) {
+    const vertex_t found = load_relaxed(edges.dests[binary_search(&e, beginning + 1, end, false).first]);
+    exists = !is_null(found) && !is_sentinel(found) && found == dest;
+  });
+  return exists;
 }
 
 // Used for debugging
 // Returns true if every neighbourhood is sorted
 // Added by Eleni Alevra
-bool PCSR::is_sorted() const {
-  for (int i = 0; i < nodes.size(); i++) {
-    int prev = 0;
-    for (int j = nodes[i].beginning + 1; j < nodes[i].end; j++) {
-      if (!is_null(edges.items[j].value)) {
-        if (edges.items[j].dest < prev) {
-          cout << prev << " " << i << " " << edges.items[j].dest << endl;
+template <typename value_t>
+bool PCSR<value_t>::is_sorted() const {
+  for (size_t i = 0; i < nodes.size(); i++) {
+    vertex_t prev = 0;
+    for (index_t j = nodes[i].beginning + 1; j < nodes[i].end; j++) {
+      if (!is_null(edges.dests[j])) {
+        if (edges.dests[j] < prev) {
+          cout << prev << " " << i << " " << edges.dests[j] << endl;
           return false;
         }
-        prev = edges.items[j].dest;
+        prev = edges.dests[j];
       }
     }
   }
@@ -889,48 +1509,64 @@ bool PCSR::is_sorted() const {
 
 // Reads the neighbourhood of vertex src
 // Added by Eleni Alevra
-void PCSR::read_neighbourhood(int src) {
-  if (src < get_n()) {
-    int k = 0;
-    for (int i = nodes[src].beginning + 1; i < nodes[src].end; i++) {
-      k = edges.items[i].dest;
+template <typename value_t>
+void PCSR<value_t>::read_neighbourhood(vertex_t src) {
+  read_optimistically(src, [&](index_t beginning, index_t end) {
+    vertex_t k = 0;
+    for (index_t i = beginning + 1; i < end; i++) {
+      k = load_relaxed(edges.dests[i]);
     }
-  }
+  });
 }
 
-vector<int> PCSR::get_neighbourhood(int src) const {
-  std::vector<int> neighbours;
-  if (src < get_n()) {
-    neighbours.reserve(nodes[src].num_neighbors);
-    for (int i = nodes[src].beginning + 1; i < nodes[src].end; i++) {
-      if (edges.items[i].value != 0) {
-        neighbours.push_back(edges.items[i].dest);
+template <typename value_t>
+vector<vertex_t> PCSR<value_t>::get_neighbourhood(vertex_t src) const {
+  std::vector<vertex_t> neighbours;
+  read_optimistically(src, [&](index_t beginning, index_t end) {
+    // a retry starts over, the slot count bounds the neighbour count even if the range is stale
+    neighbours.clear();
+    neighbours.reserve(end - beginning);
+    for (index_t i = beginning + 1; i < end; i++) {
+      const vertex_t dest = load_relaxed(edges.dests[i]);
+      if (!is_null(dest)) {
+        neighbours.push_back(dest);
       }
     }
-  }
+  });
   return neighbours;
 }
 
 // Get id of PCSR node (starting from 0)
 // e.g. if every PCSR node has 8 elements, index number 5 is in PCSR node 0, index number 8 is in PCSR node 1 etc.
 // Added by Eleni Alevra
-uint32_t PCSR::get_node_id(uint32_t node_index) const { return node_index / edges.logN; }
+template <typename value_t>
+index_t PCSR<value_t>::get_node_id(index_t node_index) const { return node_index / edges.logN; }
+
+// Returns true if the slot at index lies in the neighbourhood of src, i.e. between its sentinel and the next one.
+// Sentinels outside the locked PCSR nodes may still be moved by other threads, but never across the locked nodes,
+// so the result is stable for any index inside them.
+template <typename value_t>
+bool PCSR<value_t>::owns_slot(vertex_t src, index_t index) const {
+  return index > nodes[src].beginning && (src == nodes.size() - 1 || index < nodes[src].end);
+}
 
 // Release acquired locks and increment the version counters to notify any other thread that will acquire them
 // that a change has happened
 // Added by Eleni Alevra
-void PCSR::release_locks(pair<int, int> acquired_locks) {
-  for (int i = acquired_locks.first; i <= acquired_locks.second; i++) {
-    ++(*edges.node_locks[i]);
-    edges.node_locks[i]->unlock();
+template <typename value_t>
+void PCSR<value_t>::release_locks(pair<int64_t, int64_t> acquired_locks) {
+  for (int64_t i = acquired_locks.first; i <= acquired_locks.second; i++) {
+    ++edges.node_locks[i];
+    edges.node_locks[i].unlock();
   }
 }
 
 // Release acquired locks without incrementing version counters (we didn't make any changes to these PCSR nodes)
 // Added by Eleni Alevra
-void PCSR::release_locks_no_inc(pair<int, int> acquired_locks) {
-  for (int i = acquired_locks.first; i <= acquired_locks.second; i++) {
-    edges.node_locks[i]->unlock();
+template <typename value_t>
+void PCSR<value_t>::release_locks_no_inc(pair<int64_t, int64_t> acquired_locks) {
+  for (int64_t i = acquired_locks.first; i <= acquired_locks.second; i++) {
+    edges.node_locks[i].unlock();
   }
 }
 
@@ -946,62 +1582,62 @@ void PCSR::release_locks_no_inc(pair<int, int> acquired_locks) {
 // locks we already have and re-start acquiring from the new leftmost PCSR node
 // tries: how many times we have re-tried locking, to make sure we don't re-try too many times
 // Added by Eleni Alevra
-pair<pair<int, int>, insertion_info_t *> PCSR::acquire_insert_locks(uint32_t index, edge_t elem, uint32_t src,
-                                                                    int ins_node_v, uint32_t left_node_bound,
-                                                                    int tries) {
+template <typename value_t>
+pair<pair<int64_t, int64_t>, insertion_info_t *> PCSR<value_t>::acquire_insert_locks(index_t index, edge_t elem,
+                                                                                     vertex_t src, int ins_node_v,
+                                                                                     index_t left_node_bound,
+                                                                                     int tries) {
   if (tries > 3) {
     // very rarely happens (about 100 times in 14M insertions)
     return make_pair(make_pair(NEED_GLOBAL_WRITE, NEED_GLOBAL_WRITE), nullptr);
   }
-  int node_index = find_leaf(&edges, index);
-  int init_node_index = node_index;
+  index_t node_index = find_leaf(&edges, index);
   int level = edges.H;
-  int len = edges.logN;
-  uint32_t min_node = get_node_id(node_index);
-  uint32_t max_node = min_node;
-  uint32_t node_id = get_node_id(node_index);
-  if (left_node_bound != -1) {
-    uint32_t leftmost_node = left_node_bound;
-    for (int i = leftmost_node; i <= node_id; i++) {
-      edges.node_locks[i]->lock();
+  index_t len = edges.logN;
+  index_t min_node = get_node_id(node_index);
+  index_t max_node = min_node;
+  index_t node_id = get_node_id(node_index);
+  if (left_node_bound != NO_NODE_BOUND) {
+    index_t leftmost_node = left_node_bound;
+    for (index_t i = leftmost_node; i <= node_id; i++) {
+      edges.node_locks[i].lock();
     }
     //    if (node_id < (edges.N / edges.logN) - 1) {
-    //      edges.node_locks[node_id + 1]->lock();
+    //      edges.node_locks[node_id + 1].lock();
     //      max_node = node_id + 1;
     //    }
-    //    edges.node_locks[node_id + 1]->lock();
+    //    edges.node_locks[node_id + 1].lock();
     //    max_node = node_id + 1;
     min_node = min(min_node, leftmost_node);
   } else {
     if (node_id > 0 && !lock_bsearch) {
-      edges.node_locks[node_id - 1]->lock();
+      edges.node_locks[node_id - 1].lock();
       min_node = node_id - 1;
     }
-    edges.node_locks[node_id]->lock();
+    edges.node_locks[node_id].lock();
     //    if (node_id < (edges.N / edges.logN) - 1) {
-    //      edges.node_locks[node_id + 1]->lock();
+    //      edges.node_locks[node_id + 1].lock();
     //      max_node = node_id + 1;
     //    }
   }
-  if (ins_node_v != edges.node_locks[node_id]->load()) {
-    for (int i = min_node; i <= max_node; i++) {
-      edges.node_locks[i]->unlock();
+  if (ins_node_v != edges.node_locks[node_id].load()) {
+    for (index_t i = min_node; i <= max_node; i++) {
+      edges.node_locks[i].unlock();
     }
     return make_pair(make_pair(NEED_RETRY, NEED_RETRY), nullptr);
   }
-  if (index == edges.N - 1 && !(is_null(edges.items[index].value))) {
-    for (int i = min_node; i <= max_node; i++) {
-      edges.node_locks[i]->unlock();
+  if (index == edges.N - 1 && !(is_null(edges.dests[index]))) {
+    for (index_t i = min_node; i <= max_node; i++) {
+      edges.node_locks[i].unlock();
     }
     return make_pair(make_pair(NEED_GLOBAL_WRITE, NEED_GLOBAL_WRITE), nullptr);
   }
   if (!lock_bsearch) {
     // We didn't lock during binary search so we might have gotten back a wrong index, need to check and if it's wrong
     // re-try
-    auto ins_edge = edges.items[index];
-    if (!got_correct_insertion_index(ins_edge, src, index, elem, node_index, node_id, max_node)) {
-      for (int i = min_node; i <= max_node; i++) {
-        edges.node_locks[i]->unlock();
+    if (!got_correct_insertion_index(src, index, elem, node_index, node_id, min_node, max_node)) {
+      for (index_t i = min_node; i <= max_node; i++) {
+        edges.node_locks[i].unlock();
       }
       return make_pair(make_pair(NEED_RETRY, NEED_RETRY), nullptr);
     }
@@ -1010,10 +1646,10 @@ pair<pair<int, int>, insertion_info_t *> PCSR::acquire_insert_locks(uint32_t ind
   // check which locks we still need to acquire for redistribute
 
   if (get_density(&edges, node_index, len) + (1.0 / len) == 1) {
-    uint32_t new_node_idx = find_node(node_index, 2 * len);
-    uint32_t new_node_id = get_node_id(new_node_idx);
+    index_t new_node_idx = find_node(node_index, 2 * len);
+    index_t new_node_id = get_node_id(new_node_idx);
     if (new_node_idx == node_index && new_node_id > max_node) {
-      edges.node_locks[new_node_id]->lock();
+      edges.node_locks[new_node_id].lock();
       max_node = new_node_id;
     } else if (new_node_id < min_node) {
       release_locks_no_inc(make_pair(min_node, max_node));
@@ -1029,9 +1665,9 @@ pair<pair<int, int>, insertion_info_t *> PCSR::acquire_insert_locks(uint32_t ind
     len *= 2;
     if (len <= edges.N) {
       level--;
-      uint32_t new_node_index = find_node(node_index, len);
+      index_t new_node_index = find_node(node_index, len);
       if (new_node_index < node_index) {
-        uint32_t new_node_id = get_node_id(new_node_index);
+        index_t new_node_id = get_node_id(new_node_index);
         if (new_node_id < min_node) {
           release_locks_no_inc(make_pair(min_node, max_node));
           return acquire_insert_locks(index, elem, src, ins_node_v, get_node_id(new_node_index), tries + 1);
@@ -1039,19 +1675,19 @@ pair<pair<int, int>, insertion_info_t *> PCSR::acquire_insert_locks(uint32_t ind
         min_node = min(min_node, new_node_id);
         node_index = new_node_index;
       } else {
-        uint32_t end = get_node_id(find_leaf(&edges, new_node_index + len));
+        index_t end = get_node_id(find_leaf(&edges, new_node_index + len));
         node_index = new_node_index;
-        for (uint32_t i = max_node + 1; i < end; i++) {
+        for (index_t i = max_node + 1; i < end; i++) {
           max_node = max(max_node, i);
-          edges.node_locks[i]->lock();
+          edges.node_locks[i].lock();
           //          got_locks++;
         }
       }
       density_b = density_bound(&edges, level);
       density = get_density(&edges, node_index, len) + (1.0 / len);
     } else {
-      for (int i = min_node; i <= max_node; i++) {
-        edges.node_locks[i]->unlock();
+      for (index_t i = min_node; i <= max_node; i++) {
+        edges.node_locks[i].unlock();
       }
       insertion_info_t *info = (insertion_info_t *)malloc(sizeof(insertion_info_t));
 
@@ -1059,20 +1695,20 @@ pair<pair<int, int>, insertion_info_t *> PCSR::acquire_insert_locks(uint32_t ind
       return make_pair(make_pair(NEED_GLOBAL_WRITE, NEED_GLOBAL_WRITE), info);
     }
   }
-  uint32_t new_node_index = find_node(node_index, len);
+  index_t new_node_index = find_node(node_index, len);
   if (new_node_index < node_index) {
-    uint32_t node_id = get_node_id(new_node_index);
+    index_t node_id = get_node_id(new_node_index);
     if (node_id < min_node) {
       release_locks_no_inc(make_pair(min_node, max_node));
       return acquire_insert_locks(index, elem, src, ins_node_v, get_node_id(new_node_index), tries + 1);
     }
     min_node = min(min_node, get_node_id(new_node_index));
   } else {
-    uint32_t end = get_node_id(find_leaf(&edges, new_node_index + len));
-    for (uint32_t i = max_node + 1; i < end; i++) {
+    index_t end = get_node_id(find_leaf(&edges, new_node_index + len));
+    for (index_t i = max_node + 1; i < end; i++) {
       max_node = max(max_node, i);
       //      got_locks++;
-      edges.node_locks[i]->lock();
+      edges.node_locks[i].lock();
     }
   }
   node_index = new_node_index;
@@ -1085,33 +1721,33 @@ pair<pair<int, int>, insertion_info_t *> PCSR::acquire_insert_locks(uint32_t ind
   len = edges.logN;
   node_index = find_leaf(&edges, index);
 
-  if (!(is_null(edges.items[index].value))) {
+  if (!(is_null(edges.dests[index]))) {
     auto curr_node = get_node_id(node_index);
-    int curr_ind = index + 1;
-    uint32_t curr_node_idx = node_index;
-    if (curr_ind < edges.N && curr_ind >= curr_node_idx + len) {
+    int64_t curr_ind = index + 1;
+    int64_t curr_node_idx = node_index;
+    if (curr_ind < (int64_t)edges.N && curr_ind >= curr_node_idx + (int64_t)len) {
       curr_node_idx = curr_ind;
       curr_node++;
       if (curr_node > max_node) {
-        edges.node_locks[curr_node]->lock();
+        edges.node_locks[curr_node].lock();
         max_node = curr_node;
       }
     }
-    while (curr_ind < edges.N && !(is_null(edges.items[curr_ind].value))) {
-      if (++curr_ind < edges.N && curr_ind >= curr_node_idx + len) {
+    while (curr_ind < (int64_t)edges.N && !(is_null(edges.dests[curr_ind]))) {
+      if (++curr_ind < (int64_t)edges.N && curr_ind >= curr_node_idx + (int64_t)len) {
         curr_node++;
         if (curr_node > max_node) {
-          edges.node_locks[curr_node]->lock();
+          edges.node_locks[curr_node].lock();
           max_node = curr_node;
         }
         curr_node_idx = curr_ind;
       }
     }
-    if (curr_ind == edges.N) {
+    if (curr_ind == (int64_t)edges.N) {
       curr_ind = index;
       curr_node = get_node_id(node_index);
       curr_node_idx = node_index;
-      while (curr_ind >= 0 && !(is_null(edges.items[curr_ind].value))) {
+      while (curr_ind >= 0 && !(is_null(edges.dests[curr_ind]))) {
         if (--curr_ind >= 0 && curr_ind < curr_node_idx) {
           curr_node_idx = find_leaf(&edges, curr_ind);
           curr_node--;
@@ -1124,7 +1760,7 @@ pair<pair<int, int>, insertion_info_t *> PCSR::acquire_insert_locks(uint32_t ind
       }
       if (curr_ind == -1) {
         for (auto i = min_node; i <= max_node; i++) {
-          edges.node_locks[i]->unlock();
+          edges.node_locks[i].unlock();
         }
         return make_pair(make_pair(NEED_GLOBAL_WRITE, NEED_GLOBAL_WRITE), nullptr);
       }
@@ -1144,44 +1780,44 @@ pair<pair<int, int>, insertion_info_t *> PCSR::acquire_insert_locks(uint32_t ind
 // during redistribute we might have to lock some extra PCSR nodes to the left so to avoid deadlocks we release the
 // locks we already have and re-start acquiring from the new leftmost PCSR node
 // Added by Eleni Alevra
-pair<int, int> PCSR::acquire_remove_locks(uint32_t index, edge_t elem, uint32_t src, int ins_node_v,
-                                          uint32_t left_node_bound) {
-  int node_index = find_leaf(&edges, index);
-  // printf("node_index = %d\n", node_index);
+template <typename value_t>
+pair<int64_t, int64_t> PCSR<value_t>::acquire_remove_locks(index_t index, edge_t elem, vertex_t src, int ins_node_v,
+                                                           index_t left_node_bound) {
+  index_t node_index = find_leaf(&edges, index);
   int level = edges.H;
-  int len = edges.logN;
-  int node_id = get_node_id(node_index);
-  uint32_t min_node = node_id;
-  uint32_t max_node = node_id;
+  index_t len = edges.logN;
+  index_t node_id = get_node_id(node_index);
+  index_t min_node = node_id;
+  index_t max_node = node_id;
 
   // If we have a leftmost PCSR start locking from it
-  if (left_node_bound != -1) {
-    for (uint32_t i = left_node_bound; i <= node_id; i++) {
-      edges.node_locks[i]->lock();
+  if (left_node_bound != NO_NODE_BOUND) {
+    for (index_t i = left_node_bound; i <= node_id; i++) {
+      edges.node_locks[i].lock();
       //      got_locks++;
     }
     min_node = left_node_bound;
   } else {
-    edges.node_locks[node_id]->lock();
+    edges.node_locks[node_id].lock();
     //    got_locks++;
   }
-  if (!got_correct_insertion_index(edges.items[index], src, index, elem, node_index, node_id, max_node)) {
+  if (!got_correct_insertion_index(src, index, elem, node_index, node_id, min_node, max_node)) {
     release_locks_no_inc(make_pair(min_node, max_node));
     //    retries++;
     return make_pair(NEED_RETRY, NEED_RETRY);
   }
   // We now have the lock for the PCSR node the edge is but things might have moved since binary search so we compare
   // its version number to the one during binary search to see if any changes have happened. If they have we re-start.
-  if (edges.node_locks[node_id]->load() != ins_node_v) {
+  if (edges.node_locks[node_id].load() != ins_node_v) {
     release_locks_no_inc(make_pair(min_node, max_node));
     return make_pair(NEED_RETRY, NEED_RETRY);
   }
-  if (is_null(edges.items[index].value)) {
+  if (is_null(edges.dests[index])) {
     // Edge not found
     release_locks_no_inc(make_pair(min_node, max_node));
     return make_pair(EDGE_NOT_FOUND, EDGE_NOT_FOUND);
   } else {
-    if (is_sentinel(elem) || edges.items[index].dest != elem.dest) {
+    if (is_sentinel(elem.dest) || edges.dests[index] != elem.dest) {
       // Edge not found
       release_locks_no_inc(make_pair(min_node, max_node));
       return make_pair(EDGE_NOT_FOUND, EDGE_NOT_FOUND);
@@ -1198,14 +1834,14 @@ pair<int, int> PCSR::acquire_remove_locks(uint32_t index, edge_t elem, uint32_t
     len *= 2;
     if (len <= edges.N) {
       level--;
-      uint32_t new_node_idx = find_node(node_index, len);
-      int new_node_id = get_node_id(new_node_idx);
+      index_t new_node_idx = find_node(node_index, len);
+      index_t new_node_id = get_node_id(new_node_idx);
       if (new_node_idx < node_index && new_node_id < min_node) {
         release_locks_no_inc(make_pair(min_node, max_node));
         return acquire_remove_locks(index, elem, src, ins_node_v, new_node_id);
       }
-      for (uint32_t i = max_node + 1; i < get_node_id(new_node_idx + len); i++) {
-        edges.node_locks[i]->lock();
+      for (index_t i = max_node + 1; i < get_node_id(new_node_idx + len); i++) {
+        edges.node_locks[i].lock();
         //        got_locks++;
         max_node = i;
       }
@@ -1224,7 +1860,7 @@ pair<int, int> PCSR::acquire_remove_locks(uint32_t index, edge_t elem, uint32_t
     return acquire_remove_locks(index, elem, src, ins_node_v, new_node_id);
   }
   for (auto i = max_node + 1; i < get_node_id(new_node_idx + len); i++) {
-    edges.node_locks[i]->lock();
+    edges.node_locks[i].lock();
     //    got_locks++;
     max_node = i;
   }
@@ -1233,11 +1869,12 @@ pair<int, int> PCSR::acquire_remove_locks(uint32_t index, edge_t elem, uint32_t
 
 // Returns total number of edges in the array
 // Added by Eleni Alevra
-int PCSR::count_total_edges() {
-  int t = 0;
+template <typename value_t>
+uint64_t PCSR<value_t>::count_total_edges() {
+  uint64_t t = 0;
   for (size_t i = 0; i < nodes.size(); i++) {
     for (auto j = nodes[i].beginning + 1; j < nodes[i].end; j++) {
-      if (!(is_null(edges.items[j].value))) {
+      if (!(is_null(edges.dests[j]))) {
         t++;
       }
     }
@@ -1249,138 +1886,228 @@ int PCSR::count_total_edges() {
 // Stores the elements in the range [index, index + len) in array space and returns the redistribution step
 // and the number of elements
 // Added by Eleni Alevra
-pair<double, int> PCSR::redistr_store(edge_t *space, int index, int len) {
-  int j = 0;
+// Moves the elements of [index, index + len) to space, which needs room for the elements only, and empties the
+// range. The leaf counts of the range are left untouched, the caller recounts them once the elements are back.
+template <typename value_t>
+pair<double, index_t> PCSR<value_t>::redistr_store(edge_t *space, index_t index, index_t len) {
+  index_t j = 0;
   for (auto i = index; i < index + len; i++) {
-    space[j] = edges.items[i];
-    j += (!(is_null(edges.items[i].value)));
-    edges.items[i].value = 0;
-    edges.items[i].dest = 0;
+    if (!is_null(edges.dests[i])) {
+      space[j].dest = edges.dests[i];
+      space[j].value = values.get(i);
+      j++;
+    }
+    edges.dests[i] = NULL_DEST;
   }
   return make_pair(((double)len) / j, j);
 }
 
 // Added by Eleni Alevra
-PCSR::PCSR(uint32_t init_n, vector<condition_variable *> *cvs, bool lock_search, int domain)
-    : is_numa_available{numa_available() >= 0 && domain >= 0}, domain(domain) {
-  resizeEdgeArray(2 << bsr_word(init_n));
+// The array gets the size the other constructor picks for the same number of elements. Element of rank r (sentinel v has
+// rank v + number of edges of the nodes before v) goes to slot floor(r * N / total), the even spread redistribute
+// produces, and every worker fills a range of whole leaves as in rebuild.
+template <typename value_t>
+PCSR<value_t>::PCSR(vertex_t src_n, std::vector<batch_edge_t> edge_list, bool lock_search, int domain,
+                    MemoryBackend memory_backend)
+    : nodes(src_n),
+      is_numa_available{numa_available() >= 0 && domain >= 0},
+      domain(domain),
+      allocator(memory_backend, is_numa_available ? domain : -1),
+      domain_cpus(count_domain_cpus(is_numa_available ? domain : -1)) {
+  sort_batch(edge_list);
+  const uint64_t m = edge_list.size();
+  const uint64_t total = uint64_t(src_n) + m;
+
+  resizeEdgeArray(uint64_t(2) << bsr_word(std::max<uint64_t>(total, 1024)));
   edges.global_lock = make_shared<FastLock>();
 
-  this->redistr_mutex = new mutex;
-  this->redistr_cv = new condition_variable;
-  this->redistr_cvs = cvs;
   lock_bsearch = lock_search;
+  const index_t leaves = leaf_count(&edges);
+  edges.node_locks = allocator.allocate<leaf_lock_t>(leaves);
+  construct_locks(&edges, 0, leaves);
+  edges.dests = allocator.allocate<vertex_t>(edges.N);
+  edges.counts = allocator.allocate<std::atomic<index_t>>(2 * leaves);
+  values.allocate(edges.N, allocator);
+
+  // position of the first edge of every node in the sorted list, every worker handles the nodes whose first edge
+  // lies in its part of the list
+  vector<uint64_t> edge_begin(uint64_t(src_n) + 1);
+  const index_t sort_workers = parallel_workers(m);
+  run_workers(sort_workers, is_numa_available ? domain : -1, [&](index_t w) {
+    const uint64_t first = m * w / sort_workers;
+    const uint64_t last = m * (w + 1) / sort_workers;
+    for (uint64_t i = first; i < last; i++) {
+      for (uint64_t v = (i == 0) ? 0 : uint64_t(edge_list[i - 1].src) + 1; v <= edge_list[i].src; v++) {
+        edge_begin[v] = i;
+      }
+    }
+    if (w == sort_workers - 1) {
+      for (uint64_t v = (m == 0) ? 0 : uint64_t(edge_list[m - 1].src) + 1; v <= src_n; v++) {
+        edge_begin[v] = m;
+      }
+    }
+  });
+
+  const index_t workers = parallel_workers(edges.N);
+  run_workers(workers, is_numa_available ? domain : -1, [&](index_t w) {
+    const index_t first_leaf = uint64_t(leaves) * w / workers;
+    const index_t last_leaf = uint64_t(leaves) * (w + 1) / workers;
+    const uint64_t begin = uint64_t(first_leaf) * edges.logN;
+    const uint64_t end = uint64_t(last_leaf) * edges.logN;
+    std::fill(edges.dests + begin, edges.dests + end, NULL_DEST);
+    for (index_t leaf = first_leaf; leaf < last_leaf; leaf++) {
+      edges.counts[leaves + leaf].store(0, std::memory_order_relaxed);
+    }
+    if (total == 0) {
+      return;
+    }
+    // ranks [rank, last_rank) land in [begin, end)
+    uint64_t rank = first_rank_at(begin, total, edges.N);
+    const uint64_t last_rank = first_rank_at(end, total, edges.N);
+    if (rank >= last_rank) {
+      return;
+    }
 
-  if (is_numa_available) {
-    edges.node_locks = (HybridLock **)numa_alloc_onnode((edges.N / edges.logN) * sizeof(HybridLock *), domain);
-    checkAllocation(edges.node_locks);
-    edges.items = (edge_t *)numa_alloc_onnode(edges.N * sizeof(*(edges.items)), domain);
-    checkAllocation(edges.items);
-  } else {
-    edges.node_locks = (HybridLock **)malloc((edges.N / edges.logN) * sizeof(HybridLock *));
-    edges.items = (edge_t *)malloc(edges.N * sizeof(*(edges.items)));
-  }
-  for (uint64_t i = 0; i < edges.N; i++) {
-    edges.items[i].src = -1;
-    edges.items[i].value = 0;
-    edges.items[i].dest = 0;
-  }
-
-  for (uint32_t i = 0; i < edges.N / edges.logN; i++) {
-    edges.node_locks[i] = new HybridLock();
-  }
-
-  for (uint32_t i = 0; i < init_n; i++) {
-    add_node();
-  }
+    // node of the element of rank rank, the last one whose sentinel comes at or before it
+    uint64_t v = 0;
+    for (uint64_t hi = src_n; hi - v > 1;) {
+      const uint64_t mid = v + (hi - v) / 2;
+      if (mid + edge_begin[mid] <= rank) {
+        v = mid;
+      } else {
+        hi = mid;
+      }
+    }
+    auto sentinel_rank = [&](uint64_t u) { return (u < src_n) ? u + edge_begin[u] : total; };
+    uint64_t next_sentinel = sentinel_rank(v + 1);
+
+    spread_cursor cursor(rank, total, edges.N);
+    index_t leaf = cursor.pos / edges.logN;
+    index_t occupied = 0;
+    for (; rank < last_rank; rank++, cursor.next()) {
+      const uint64_t pos = cursor.pos;
+      if (pos / edges.logN != leaf) {
+        edges.counts[leaves + leaf].store(occupied, std::memory_order_relaxed);
+        leaf = pos / edges.logN;
+        occupied = 0;
+      }
+      if (rank == next_sentinel) {
+        next_sentinel = sentinel_rank(++v + 1);
+      }
+      if (rank == sentinel_rank(v)) {
+        edges.dests[pos] = SENTINEL_FLAG | v;  // back pointer
+        nodes[v].num_neighbors = edge_begin[v + 1] - edge_begin[v];
+        fix_sentinel(edges.dests[pos], pos);
+      } else {
+        // the edges of v follow its sentinel
+        const batch_edge_t &e = edge_list[rank - v - 1];
+        edges.dests[pos] = e.dest;
+        values.set(pos, e.value);
+      }
+      occupied++;
+    }
+    edges.counts[leaves + leaf].store(occupied, std::memory_order_relaxed);
+  });
+  update_subtree(&edges, 0, leaves);
 }
 
 // Returns total number of edges in range [index, index + len)
 // Added by Eleni Alevra
-int PCSR::count_elems(int index, int len) {
-  int j = 0;
-  for (auto i = index; i < index + len; i++) {
-    j += !(is_null(edges.items[i].value)) && !is_sentinel(edges.items[i]);
-  }
-  return j;
+template <typename value_t>
+index_t PCSR<value_t>::count_elems(index_t index, index_t len) {
+  // the sentinels in the range belong to the nodes beginning there, nodes are ordered by their beginning
+  const auto before = [](const node_t &node, index_t i) { return node.beginning < i; };
+  const auto first = lower_bound(nodes.begin(), nodes.end(), index, before);
+  const auto last = lower_bound(first, nodes.end(), index + len, before);
+  return occupied_slots(&edges, index, len) - (last - first);
 }
 
 // Returns true if the given edge should be inserted in index
 // Added by Eleni Alevra
-bool PCSR::got_correct_insertion_index(edge_t ins_edge, uint32_t src, uint32_t index, edge_t elem, int node_index,
-                                       int node_id, uint32_t &max_node) {
+template <typename value_t>
+bool PCSR<value_t>::got_correct_insertion_index(vertex_t src, index_t index, edge_t elem, index_t node_index,
+                                                index_t node_id, index_t min_node, index_t &max_node) {
+  const vertex_t ins_dest = edges.dests[index];
+  const bool last_node = src == nodes.size() - 1;
   // Check that we are in the right neighbourhood
-  if (!(is_null(ins_edge.value)) &&
-      ((is_sentinel(ins_edge) && src != nodes.size() - 1 && ins_edge.src != src + 1) ||
-       (is_sentinel(ins_edge) && src == nodes.size() - 1 && ins_edge.value != UINT32_MAX) ||
-       (!is_sentinel(ins_edge) && ins_edge.src != src))) {
+  if (!(is_null(ins_dest)) && ((is_sentinel(ins_dest) && (last_node || sentinel_id(ins_dest) != src + 1)) ||
+                               (!is_sentinel(ins_dest) && !owns_slot(src, index)))) {
     return false;
   }
   // Check that the current edge is larger than the one we want to insert
-  if (!(is_null(ins_edge.value)) && !is_sentinel(ins_edge) && ins_edge.dest < elem.dest) {
+  if (!(is_null(ins_dest)) && !is_sentinel(ins_dest) && ins_dest < elem.dest) {
     return false;
   }
-  if (is_null(ins_edge.value)) {
+  if (is_null(ins_dest)) {
     // The current position is empty so we need to find the next element to the right to make sure it's bigger than the
     // one we want to insert
-    int ind = index + 1;
+    index_t ind = index + 1;
     auto curr_n = node_index;
     if (ind < edges.N && ind >= curr_n + edges.logN) {
       curr_n += edges.logN;
-      edges.node_locks[++max_node]->lock();
+      edges.node_locks[++max_node].lock();
     }
-    while (ind < edges.N && is_null(edges.items[ind].value)) {
+    while (ind < edges.N && is_null(edges.dests[ind])) {
       ind++;
       if (ind < edges.N && ind >= curr_n + edges.logN) {
         curr_n += edges.logN;
-        edges.node_locks[++max_node]->lock();
+        edges.node_locks[++max_node].lock();
       }
     }
 
     if (ind < edges.N) {
-      edge_t item = edges.items[ind];
-      // if it's in the same neighbourhood and smaller we're in the wrong position
-      if (!is_null(item.value) && !is_sentinel(item) && item.src == src && item.dest < elem.dest) {
+      const vertex_t item = edges.dests[ind];
+      // an edge has to belong to src and be larger, else we're in the wrong position. If it's the edge itself the
+      // search stopped short of it while it moved.
+      if (!is_null(item) && !is_sentinel(item) && (!owns_slot(src, ind) || item <= elem.dest)) {
         return false;
       }
       // if it's a sentinel node for the wrong vertex the index is wrong
-      if (!(is_null(item.value)) && is_sentinel(item) &&
-          ((src != nodes.size() - 1 && item.value != src + 1) ||
-           (src == nodes.size() - 1 && item.value == UINT32_MAX))) {
+      if (!(is_null(item)) && is_sentinel(item) && !last_node && sentinel_id(item) != src + 1) {
         return false;
       }
     }
   }
   // Go to the left to find the next element to the left and make sure it's less than the one we are inserting
-  auto ind = index - 1;
-  edge_t item;
-  item.value = 0;
-  item.dest = 0;
-  item.src = -1;
-  while (ind >= 0 && is_null(edges.items[ind].value)) {
-    ind--;
-  }
-  item = edges.items[ind];
-  if (!is_null(item.value) && !is_sentinel(item) && item.src == src && item.dest >= elem.dest) {
-    return false;
+  // the array always starts with a sentinel, so this stops before running off the front.
+  // The scan may leave the locked PCSR nodes, their elements can move meanwhile. Like an optimistic read it takes the
+  // sequence numbers of these nodes when it enters them and checks them at the end, a torn scan counts as a wrong index.
+  int64_t ind = int64_t(index) - 1;
+  index_t first_scanned = min_node;
+  uint64_t before = 0;
+  bool writing = false;
+  for (; ind >= 0; ind--) {
+    const index_t leaf = get_node_id(ind);
+    if (leaf < first_scanned) {
+      first_scanned = leaf;
+      const unsigned sequence = edges.node_locks[leaf].read_begin();
+      writing |= (sequence & 1) != 0;
+      before += sequence;
+    }
+    if (!is_null(edges.dests[ind])) {
+      break;
+    }
   }
-  if (!is_null(item.value) && is_sentinel(item) &&
-      ((src == 0 && item.value != UINT32_MAX) || (src != 0 && item.value != src))) {
-    return false;
+  const vertex_t item = edges.dests[ind];
+  const bool wrong_left = !is_null(item) && ((!is_sentinel(item) && (!owns_slot(src, ind) || item >= elem.dest)) ||
+                                             (is_sentinel(item) && sentinel_id(item) != src));
+  uint64_t after = 0;
+  for (index_t leaf = first_scanned; leaf < min_node; leaf++) {
+    after += edges.node_locks[leaf].read_end();
   }
-  return true;
+  return !writing && after == before && !wrong_left;
 }
 
-void PCSR::add_edge_parallel(uint32_t src, uint32_t dest, uint32_t value, int retries) {
-  if (value != 0 && src < get_n()) {
+template <typename value_t>
+void PCSR<value_t>::add_edge_parallel(vertex_t src, vertex_t dest, value_type value, int retries) {
+  if (src < get_n()) {
     edge_t e;
-    e.src = src;
     e.dest = dest;
     e.value = value;
     if (retries > 3) {
       const std::lock_guard<FastLock> lck(*edges.global_lock);
       nodes[src].num_neighbors++;
-      int pos = binary_search(&e, nodes[src].beginning + 1, nodes[src].end, false).first;
+      index_t pos = binary_search(&e, nodes[src].beginning + 1, nodes[src].end, false).first;
       insert(pos, e, src, nullptr);
       return;
     }
@@ -1388,20 +2115,20 @@ void PCSR::add_edge_parallel(uint32_t src, uint32_t dest, uint32_t value, int re
     edges.global_lock->lock_shared();
     auto beginning = nodes[src].beginning;
     auto end = nodes[src].end;
-    uint32_t first_node = get_node_id(find_leaf(&edges, beginning + 1));
+    index_t first_node = get_node_id(find_leaf(&edges, beginning + 1));
     nodes[src].num_neighbors++;
-    pair<uint32_t, int> bs;
-    uint32_t loc_to_add;
+    pair<index_t, int> bs;
+    index_t loc_to_add;
     if (lock_bsearch) {
-      uint32_t last_node = get_node_id(find_leaf(&edges, end));
+      index_t last_node = get_node_id(find_leaf(&edges, end));
       // Lock for binary search
-      for (uint32_t i = first_node; i <= last_node; i++) {
-        edges.node_locks[i]->lock_shared();
+      for (index_t i = first_node; i <= last_node; i++) {
+        edges.node_locks[i].lock_shared();
       }
       // If after we have locked there have been more edges added, re-start to include them in the search
       if (nodes[src].beginning != beginning || nodes[src].end != end) {
         for (auto i = first_node; i <= last_node; i++) {
-          edges.node_locks[i]->unlock_shared();
+          edges.node_locks[i].unlock_shared();
         }
         edges.global_lock->unlock_shared();
         nodes[src].num_neighbors--;
@@ -1414,7 +2141,7 @@ void PCSR::add_edge_parallel(uint32_t src, uint32_t dest, uint32_t value, int re
       // get back index where the new edge should go and the version number of its PCSR node when we read its value
       bs = binary_search(&e, beginning + 1, end, false);
       loc_to_add = bs.first;
-      uint32_t index_node = get_node_id(find_leaf(&edges, loc_to_add));
+      index_t index_node = get_node_id(find_leaf(&edges, loc_to_add));
       if (index_node < first_node) {
         nodes[src].num_neighbors--;
         edges.global_lock->unlock_shared();
@@ -1422,8 +2149,8 @@ void PCSR::add_edge_parallel(uint32_t src, uint32_t dest, uint32_t value, int re
         return;
       }
     }
-    pair<pair<int, int>, insertion_info_t *> acquired_locks =
-        acquire_insert_locks(loc_to_add, e, src, bs.second, -1, 0);
+    pair<pair<int64_t, int64_t>, insertion_info_t *> acquired_locks =
+        acquire_insert_locks(loc_to_add, e, src, bs.second, NO_NODE_BOUND, 0);
     if (acquired_locks.first.first == NEED_RETRY) {
       nodes[src].num_neighbors--;
       edges.global_lock->unlock_shared();
@@ -1444,25 +2171,402 @@ void PCSR::add_edge_parallel(uint32_t src, uint32_t dest, uint32_t value, int re
   }
 }
 
-void PCSR::insert_nodes_and_edges_front(std::vector<node_t> new_nodes, std::vector<edge_t> new_edges) {
-  (void)new_nodes;
-  (void)new_edges;
+template <typename value_t>
+void PCSR<value_t>::sort_batch(std::vector<batch_edge_t> &batch) const {
+  const uint64_t n = get_n();
+  batch.erase(std::remove_if(batch.begin(), batch.end(), [n](const batch_edge_t &e) { return e.src >= n; }),
+              batch.end());
+  parallel_stable_sort(batch, parallel_workers(batch.size()), is_numa_available ? domain : -1,
+                       [](const batch_edge_t &a, const batch_edge_t &b) {
+                         return a.src < b.src || (a.src == b.src && a.dest < b.dest);
+                       });
+  // later duplicates win, as they would with consecutive add_edge calls. Deduplicating the reversed batch keeps the
+  // last edge of every run, at the back of the batch.
+  batch.erase(batch.begin(), std::unique(batch.rbegin(), batch.rend(), [](const batch_edge_t &a, const batch_edge_t &b) {
+                               return a.src == b.src && a.dest == b.dest;
+                             }).base());
 }
 
-void PCSR::insert_nodes_and_edges_back(std::vector<node_t> new_nodes, std::vector<edge_t> new_edges) {
-  (void)new_nodes;
-  (void)new_edges;
+// The batch is merged in three steps: every new edge is tagged with the slot of the element it will follow, the array
+// is grown once if the batch would overfill it, and then the tagged edges are merged leaf by leaf from left to right.
+// Like insert, a leaf that would get too dense is merged together with its neighbours in the smallest enclosing window
+// that stays within the density bound of its level.
+template <typename value_t>
+void PCSR<value_t>::add_edges_batch(std::vector<batch_edge_t> batch) {
+  sort_batch(batch);
+
+  const std::lock_guard<FastLock> lck(*edges.global_lock);
+  // slot of every edge of the batch that already exists, and for the new edges the slot of the element they follow
+  constexpr uint64_t NOT_FOUND = std::numeric_limits<uint64_t>::max();
+  vector<uint64_t> found(batch.size());
+  vector<index_t> after;
+  vector<edge_t> items;
+  auto locate = [&]() {
+    after.clear();
+    items.clear();
+    for (size_t i = 0; i < batch.size(); i++) {
+      edge_t e;
+      e.dest = batch[i].dest;
+      e.value = batch[i].value;
+      const node_t &node = nodes[batch[i].src];
+      const index_t pos = binary_search(&e, node.beginning + 1, node.end, false).first;
+      const vertex_t item = edges.dests[pos];
+      found[i] = NOT_FOUND;
+      if (item == e.dest) {
+        found[i] = pos;
+        continue;
+      }
+      // the end of the last node is no sentinel and may hold a smaller edge
+      after.push_back((!is_null(item) && !is_sentinel(item) && item < e.dest) ? pos : prev_occupied(&edges, pos - 1));
+      items.push_back(e);
+    }
+  };
+  locate();
+
+  // grow the array once if the batch would push the root above its density bound
+  const uint64_t total = edges.counts[1].load(std::memory_order_relaxed) + items.size();
+  uint64_t new_size = edges.N;
+  while (total >= density_bound(&edges, 0).y * new_size) {
+    new_size *= 2;
+  }
+  if (new_size != edges.N) {
+    rebuild(new_size);
+    locate();
+  }
+
+  for (size_t i = 0; i < batch.size(); i++) {
+    if (found[i] != NOT_FOUND) {
+      values.set(found[i], batch[i].value);
+    } else {
+      nodes[batch[i].src].num_neighbors++;
+    }
+  }
+
+  vector<edge_t> space;
+  for (size_t i = 0; i < items.size();) {
+    index_t node_index = find_leaf(&edges, after[i]);
+    index_t len = edges.logN;
+    int level = edges.H;
+    size_t last;
+    // the root always fits after the resize above
+    for (;;) {
+      last = std::lower_bound(after.begin() + i, after.end(), uint64_t(node_index) + len) - after.begin();
+      const double density = static_cast<double>(occupied_slots(&edges, node_index, len) + last - i) / len;
+      if (density < density_bound(&edges, level).y || len == edges.N) {
+        break;
+      }
+      len *= 2;
+      level--;
+      node_index = find_node(node_index, len);
+    }
+    merge_window(node_index, len, after.data() + i, items.data() + i, last - i, space);
+    i = last;
+  }
 }
 
-std::pair<std::vector<node_t>, std::vector<edge_t>> PCSR::remove_nodes_and_edges_front(int num_nodes) {
-  (void)num_nodes;
-  std::vector<node_t> exported_nodes;
-  std::vector<edge_t> exported_edges;
-  return make_pair(exported_nodes, exported_edges);
+// Removed edges leave empty slots behind and only their leaf counts change while the batch is applied. Afterwards the
+// array is shrunk once if the root fell below its density bound, otherwise every leaf that got too sparse is
+// redistributed together with its neighbours in the smallest enclosing window that is dense enough again.
+template <typename value_t>
+void PCSR<value_t>::remove_edges_batch(std::vector<std::pair<vertex_t, vertex_t>> batch) {
+  const uint64_t n = get_n();
+  batch.erase(std::remove_if(batch.begin(), batch.end(),
+                             [n](const std::pair<vertex_t, vertex_t> &e) { return e.first >= n; }),
+              batch.end());
+  std::sort(batch.begin(), batch.end());
+  batch.erase(std::unique(batch.begin(), batch.end()), batch.end());
+
+  const std::lock_guard<FastLock> lck(*edges.global_lock);
+  // leaves that lost edges, ascending as the batch is sorted
+  vector<index_t> sparse_leaves;
+  for (const auto &r : batch) {
+    edge_t e;
+    e.dest = r.second;
+    e.value = value_type();
+    const node_t &node = nodes[r.first];
+    const index_t pos = binary_search(&e, node.beginning + 1, node.end, false).first;
+    if (edges.dests[pos] != e.dest) {
+      continue;
+    }
+    edges.dests[pos] = NULL_DEST;
+    add_to_count(&edges, pos, -1);
+    nodes[r.first].num_neighbors--;
+    if (sparse_leaves.empty() || sparse_leaves.back() != pos / edges.logN) {
+      sparse_leaves.push_back(pos / edges.logN);
+    }
+  }
+  if (sparse_leaves.empty()) {
+    return;
+  }
+  rebalance_sparse_leaves(sparse_leaves);
 }
-std::pair<std::vector<node_t>, std::vector<edge_t>> PCSR::remove_nodes_and_edges_back(int num_nodes) {
-  (void)num_nodes;
-  std::vector<node_t> exported_nodes;
+
+template <typename value_t>
+void PCSR<value_t>::rebalance_sparse_leaves(const vector<index_t> &sparse_leaves) {
+  // shrink to the final size at once, the rebuild spreads all elements evenly
+  const uint64_t total = edges.counts[1].load(std::memory_order_relaxed);
+  uint64_t new_size = edges.N;
+  while (new_size > MIN_EDGE_ARRAY_SIZE && total < density_bound(&edges, 0).x * new_size) {
+    new_size /= 2;
+  }
+  if (new_size != edges.N) {
+    rebuild(new_size);
+    return;
+  }
+
+  // end of the last redistributed window, the leaves in front of it are balanced already
+  uint64_t balanced_end = 0;
+  for (index_t leaf : sparse_leaves) {
+    index_t node_index = leaf * edges.logN;
+    if (node_index < balanced_end) {
+      continue;
+    }
+    index_t len = edges.logN;
+    int level = edges.H;
+    if (get_density(&edges, node_index, len) >= density_bound(&edges, level).x) {
+      continue;
+    }
+    do {
+      len *= 2;
+      level--;
+      node_index = find_node(node_index, len);
+    } while (len < edges.N && get_density(&edges, node_index, len) < density_bound(&edges, level).x);
+    redistribute(node_index, len);
+    balanced_end = uint64_t(node_index) + len;
+  }
+}
+
+template <typename value_t>
+void PCSR<value_t>::clear_range(uint64_t begin, uint64_t end, vector<index_t> &sparse_leaves) {
+  for (uint64_t i = begin; i < end;) {
+    const uint64_t leaf_end = std::min<uint64_t>(end, (i / edges.logN + 1) * edges.logN);
+    const int removed = __builtin_popcountll(scan_leaf(edges.dests + i, leaf_end - i, 0).occupied);
+    if (removed > 0) {
+      std::fill(edges.dests + i, edges.dests + leaf_end, NULL_DEST);
+      add_to_count(&edges, i, -removed);
+      sparse_leaves.push_back(i / edges.logN);
+    }
+    i = leaf_end;
+  }
+}
+
+// Every worker scans a range of whole leaves and only touches the counts of its leaves, the inner nodes of the count
+// tree and the neighbour counts of the sources are fixed up afterwards
+template <typename value_t>
+void PCSR<value_t>::remove_edges_to_locked(vertex_t dest, vector<index_t> &sparse_leaves) {
+  const index_t leaves = leaf_count(&edges);
+  const index_t workers = parallel_workers(edges.N);
+  vector<vector<index_t>> removed(workers);
+  run_workers(workers, is_numa_available ? domain : -1, [&](index_t w) {
+    const index_t last_leaf = uint64_t(leaves) * (w + 1) / workers;
+    for (index_t leaf = uint64_t(leaves) * w / workers; leaf < last_leaf; leaf++) {
+      const uint64_t begin = uint64_t(leaf) * edges.logN;
+      // slots below dest + 1 but not below dest, sentinels and empty slots compare larger than both
+      uint64_t hits = scan_leaf(edges.dests + begin, edges.logN, dest + 1).less &
+                      ~scan_leaf(edges.dests + begin, edges.logN, dest).less;
+      if (hits == 0) {
+        continue;
+      }
+      edges.counts[leaves + leaf].fetch_sub(__builtin_popcountll(hits), std::memory_order_relaxed);
+      for (; hits != 0; hits &= hits - 1) {
+        const index_t slot = begin + __builtin_ctzll(hits);
+        edges.dests[slot] = NULL_DEST;
+        removed[w].push_back(slot);
+      }
+    }
+  });
+
+  bool any = false;
+  for (const auto &slots : removed) {
+    for (index_t slot : slots) {
+      // source of the edge, the last node starting before it
+      auto node = std::upper_bound(nodes.begin(), nodes.end(), slot,
+                                   [](index_t i, const node_t &n) { return i < n.beginning; });
+      (node - 1)->num_neighbors--;
+      if (sparse_leaves.empty() || sparse_leaves.back() != slot / edges.logN) {
+        sparse_leaves.push_back(slot / edges.logN);
+      }
+      any = true;
+    }
+  }
+  if (any) {
+    update_subtree(&edges, 0, leaves);
+  }
+}
+
+template <typename value_t>
+void PCSR<value_t>::clear_neighbourhood(vertex_t src) {
+  if (src >= get_n()) {
+    return;
+  }
+  const std::lock_guard<FastLock> lck(*edges.global_lock);
+  vector<index_t> sparse_leaves;
+  clear_range(uint64_t(nodes[src].beginning) + 1, (src == nodes.size() - 1) ? edges.N : nodes[src].end,
+              sparse_leaves);
+  nodes[src].num_neighbors = 0;
+  rebalance_sparse_leaves(sparse_leaves);
+}
+
+template <typename value_t>
+void PCSR<value_t>::remove_edges_to(vertex_t dest) {
+  const std::lock_guard<FastLock> lck(*edges.global_lock);
+  vector<index_t> sparse_leaves;
+  remove_edges_to_locked(dest, sparse_leaves);
+  rebalance_sparse_leaves(sparse_leaves);
+}
+
+template <typename value_t>
+void PCSR<value_t>::remove_node(vertex_t src) {
+  remove_node(src, src);
+}
+
+template <typename value_t>
+void PCSR<value_t>::remove_node(vertex_t src, vertex_t id) {
+  const std::lock_guard<FastLock> lck(*edges.global_lock);
+  if (src >= get_n() || std::find(free_nodes.begin(), free_nodes.end(), src) != free_nodes.end()) {
+    return;
+  }
+  vector<index_t> sparse_leaves;
+  clear_range(uint64_t(nodes[src].beginning) + 1, (src == nodes.size() - 1) ? edges.N : nodes[src].end,
+              sparse_leaves);
+  nodes[src].num_neighbors = 0;
+  remove_edges_to_locked(id, sparse_leaves);
+  std::sort(sparse_leaves.begin(), sparse_leaves.end());
+  sparse_leaves.erase(std::unique(sparse_leaves.begin(), sparse_leaves.end()), sparse_leaves.end());
+  rebalance_sparse_leaves(sparse_leaves);
+  free_nodes.push_back(src);
+}
+
+template <typename value_t>
+uint64_t PCSR<value_t>::fitting_size(uint64_t total) {
+  const pair_double bound = density_bound(&edges, 0);
+  uint64_t size = edges.N;
+  while (total >= bound.y * size) {
+    size *= 2;
+  }
+  while (size > MIN_EDGE_ARRAY_SIZE && total < bound.x * size) {
+    size /= 2;
+  }
+  return size;
+}
+
+template <typename value_t>
+std::pair<std::vector<node_t>, std::vector<edge<value_t>>> PCSR<value_t>::export_nodes(vertex_t first,
+                                                                                         vertex_t count) const {
+  std::vector<node_t> exported_nodes(count);
   std::vector<edge_t> exported_edges;
+  for (vertex_t u = first; u < first + count; u++) {
+    const uint64_t begin = uint64_t(nodes[u].beginning) + 1;
+    const uint64_t end = (u == nodes.size() - 1) ? edges.N : nodes[u].end;
+    node_t &node = exported_nodes[u - first];
+    node.beginning = exported_edges.size();
+    for (uint64_t i = begin; i < end; i += LEAF_SCAN_MAX_LEN) {
+      const size_t chunk = std::min<uint64_t>(LEAF_SCAN_MAX_LEN, end - i);
+      for (uint64_t mask = scan_leaf(edges.dests + i, chunk, 0).occupied; mask != 0; mask &= mask - 1) {
+        const uint64_t slot = i + __builtin_ctzll(mask);
+        exported_edges.push_back(edge_t{edges.dests[slot], values.get(slot)});
+      }
+    }
+    node.end = exported_edges.size();
+    node.num_neighbors = nodes[u].num_neighbors;
+  }
   return make_pair(exported_nodes, exported_edges);
-}
\ No newline at end of file
+}
+
+template <typename value_t>
+std::vector<edge<value_t>> PCSR<value_t>::import_nodes(const std::vector<node_t> &new_nodes,
+                                                       const std::vector<edge_t> &new_edges, vertex_t first_id) const {
+  std::vector<edge_t> elements;
+  elements.reserve(new_nodes.size() + new_edges.size());
+  for (size_t i = 0; i < new_nodes.size(); i++) {
+    elements.push_back(edge_t{SENTINEL_FLAG | vertex_t(first_id + i), value_type()});
+    elements.insert(elements.end(), new_edges.begin() + new_nodes[i].beginning,
+                    new_edges.begin() + new_nodes[i].end);
+  }
+  return elements;
+}
+
+template <typename value_t>
+void PCSR<value_t>::insert_nodes_and_edges_front(std::vector<node_t> new_nodes, std::vector<edge_t> new_edges) {
+  if (new_nodes.empty()) {
+    return;
+  }
+  const std::lock_guard<FastLock> lck(*edges.global_lock);
+  const vertex_t count = new_nodes.size();
+  splice_t splice;
+  splice.front = import_nodes(new_nodes, new_edges, 0);
+  splice.id_shift = count;
+  for (auto &node : new_nodes) {
+    node.beginning = node.end = 0;
+  }
+  nodes.insert(nodes.begin(), new_nodes.begin(), new_nodes.end());
+  for (auto &id : free_nodes) {
+    id += count;
+  }
+  rebuild(fitting_size(edges.counts[1].load(std::memory_order_relaxed) + splice.front.size()), splice);
+}
+
+template <typename value_t>
+void PCSR<value_t>::insert_nodes_and_edges_back(std::vector<node_t> new_nodes, std::vector<edge_t> new_edges) {
+  if (new_nodes.empty()) {
+    return;
+  }
+  const std::lock_guard<FastLock> lck(*edges.global_lock);
+  splice_t splice;
+  splice.back = import_nodes(new_nodes, new_edges, nodes.size());
+  for (auto &node : new_nodes) {
+    node.beginning = node.end = 0;
+  }
+  nodes.insert(nodes.end(), new_nodes.begin(), new_nodes.end());
+  rebuild(fitting_size(edges.counts[1].load(std::memory_order_relaxed) + splice.back.size()), splice);
+}
+
+template <typename value_t>
+std::pair<std::vector<node_t>, std::vector<edge<value_t>>> PCSR<value_t>::remove_nodes_and_edges_front(vertex_t num_nodes) {
+  const std::lock_guard<FastLock> lck(*edges.global_lock);
+  num_nodes = std::min<vertex_t>(num_nodes, nodes.size());
+  auto exported = export_nodes(0, num_nodes);
+  if (num_nodes == 0) {
+    return exported;
+  }
+  splice_t splice;
+  splice.drop_front = num_nodes + exported.second.size();
+  splice.id_shift = vertex_t(0) - num_nodes;
+  nodes.erase(nodes.begin(), nodes.begin() + num_nodes);
+  free_nodes.erase(std::remove_if(free_nodes.begin(), free_nodes.end(), [&](vertex_t id) { return id < num_nodes; }),
+                   free_nodes.end());
+  for (auto &id : free_nodes) {
+    id -= num_nodes;
+  }
+  rebuild(fitting_size(edges.counts[1].load(std::memory_order_relaxed) - splice.drop_front), splice);
+  return exported;
+}
+
+template <typename value_t>
+std::pair<std::vector<node_t>, std::vector<edge<value_t>>> PCSR<value_t>::remove_nodes_and_edges_back(vertex_t num_nodes) {
+  const std::lock_guard<FastLock> lck(*edges.global_lock);
+  num_nodes = std::min<vertex_t>(num_nodes, nodes.size());
+  const vertex_t first = nodes.size() - num_nodes;
+  auto exported = export_nodes(first, num_nodes);
+  if (num_nodes == 0) {
+    return exported;
+  }
+  splice_t splice;
+  splice.drop_back = num_nodes + exported.second.size();
+  nodes.erase(nodes.begin() + first, nodes.end());
+  free_nodes.erase(std::remove_if(free_nodes.begin(), free_nodes.end(), [&](vertex_t id) { return id >= first; }),
+                   free_nodes.end());
+  rebuild(fitting_size(edges.counts[1].load(std::memory_order_relaxed) - splice.drop_back), splice);
+  return exported;
+}
+
+template class EdgeValues<uint32_t>;
+template class EdgeValues<uint64_t>;
+template class EdgeValues<float>;
+template class EdgeValues<double>;
+
+template class PCSR<void>;
+template class PCSR<uint32_t>;
+template class PCSR<uint64_t>;
+template class PCSR<float>;
+template class PCSR<double>;
@@ -4,10 +4,19 @@
  */
 
 #include <fastLock.h>
+#include <types.h>
 
 #include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <utility>
 #include <vector>
 
+#include "edgeArrayAllocator.h"
 #include "hybridLock.h"
 
 using namespace std;
@@ -17,65 +26,257 @@ using namespace std;
 /** Types */
 typedef struct _node {
   // beginning and end of the associated region in the edge list
-  uint32_t beginning;      // deleted = max int
-  uint32_t end;            // end pointer is exclusive
-  uint32_t num_neighbors;  // number of edges with this node as source
+  index_t beginning;      // deleted = max int
+  index_t end;            // end pointer is exclusive
+  index_t num_neighbors;  // number of edges with this node as source
 } node_t;
 
-// each node has an associated sentinel (max_int, offset) that gets back to its
-// offset into the node array
-// UINT32_MAX
+// The edge array is stored as a structure of arrays: one array with the destination of every slot and, for weighted
+// graphs, one with the edge values (see EdgeValues). The source of an edge is not stored, it is implied by the sentinel
+// range in nodes the slot lies in.
 //
-// if value == UINT32_MAX, read it as null.
-typedef struct _edge {
-  uint32_t src;
-  uint32_t dest;  // destination of this edge in the graph, MAX_INT if this is a
-  // sentinel
-  uint32_t value;  // edge value of zero means it a null since we don't store 0 edges
-} edge_t;
+// Empty slots and sentinels are encoded in the destination alone, so scans only have to touch the dest array:
+// NULL_DEST marks an empty slot, SENTINEL_FLAG marks a sentinel and the remaining bits hold a back pointer to the
+// node that starts at the sentinel.
+constexpr vertex_t NULL_DEST = std::numeric_limits<vertex_t>::max();
+constexpr vertex_t SENTINEL_FLAG = vertex_t(1) << (std::numeric_limits<vertex_t>::digits - 1);
+
+// Unweighted graphs (value type void) store no edge values, unweighted_t stands in for the value in the API
+struct unweighted_t {};
+
+constexpr bool operator==(unweighted_t, unweighted_t) { return true; }
+
+// Type used to pass edge values in and out of the data structure
+template <typename value_t>
+struct edge_value {
+  typedef value_t type;
+};
+
+template <>
+struct edge_value<void> {
+  typedef unweighted_t type;
+};
+
+template <typename value_t>
+struct edge {
+  vertex_t dest;                            // destination of this edge, SENTINEL_FLAG | node id if this is a sentinel
+  typename edge_value<value_t>::type value;  // edge value
+};
+
+// edge together with its source, the unit of the batch API
+template <typename value_t>
+struct batch_edge {
+  vertex_t src;
+  vertex_t dest;
+  typename edge_value<value_t>::type value;
+};
 
 typedef struct edge_list {
   uint64_t N;
   int H;
   int logN;
   shared_ptr<FastLock> global_lock;
-  HybridLock **node_locks;  // locks for every PCSR leaf node
-  edge_t *items;
+  leaf_lock_t *node_locks;  // lock of every PCSR leaf node, allocated by the PCSR's EdgeArrayAllocator
+  vertex_t *dests;          // destinations of all slots, allocated by the PCSR's EdgeArrayAllocator
+  // implicit tree of occupied slot counts (edges and sentinels): leaf i of the PCSR is counts[N / logN + i], node k
+  // holds the sum of nodes 2k and 2k + 1. Leaves are updated under their leaf lock, inner nodes atomically.
+  std::atomic<index_t> *counts;
 } edge_list_t;
 
+/**
+ * Cache-line-aligned array with the value of every slot of the edge array
+ * The values of empty slots and sentinels are meaningless.
+ */
+template <typename value_t>
+class EdgeValues {
+ public:
+  typedef value_t value_type;
+
+  // number of bytes stored per slot
+  static constexpr size_t slot_size = sizeof(value_t);
+
+  void allocate(size_t count, const EdgeArrayAllocator &allocator);
+  void reallocate(size_t old_count, size_t new_count, const EdgeArrayAllocator &allocator);
+  void release(size_t count, const EdgeArrayAllocator &allocator);
+
+  value_t get(size_t i) const { return data[i]; }
+  void set(size_t i, value_t value) { data[i] = value; }
+  void clear(size_t i) { data[i] = value_t(); }
+  void move(size_t to, size_t from) { data[to] = data[from]; }
+  // copies the value of slot from_index of another array into slot to
+  void copy(size_t to, const EdgeValues &from, size_t from_index) { data[to] = from.data[from_index]; }
+  // moves count values from slot from on to slot to on, the ranges may overlap
+  void move_range(size_t to, size_t from, size_t count) { memmove(data + to, data + from, count * sizeof(value_t)); }
+  void swap(size_t i, size_t j) { std::swap(data[i], data[j]); }
+
+ private:
+  value_t *data = nullptr;
+};
+
+/**
+ * Unweighted graphs don't store any values, so every operation is a no-op
+ */
+template <>
+class EdgeValues<void> {
+ public:
+  typedef unweighted_t value_type;
+
+  static constexpr size_t slot_size = 0;
+
+  void allocate(size_t, const EdgeArrayAllocator &) {}
+  void reallocate(size_t, size_t, const EdgeArrayAllocator &) {}
+  void release(size_t, const EdgeArrayAllocator &) {}
+
+  unweighted_t get(size_t) const { return unweighted_t(); }
+  void set(size_t, unweighted_t) {}
+  void clear(size_t) {}
+  void move(size_t, size_t) {}
+  void copy(size_t, const EdgeValues &, size_t) {}
+  void move_range(size_t, size_t, size_t) {}
+  void swap(size_t, size_t) {}
+};
+
 // When we acquire locks to insert we have to make checks to see up to which position we will redistribute
 // during the insert
 // To avoid repeating this check during the actual insertion we pass this struct to it so it can immediately know
 // up to where it needs to redistribute
 typedef struct insertion_info {
-  uint32_t first_empty;  // first empty spot for slide
-  int max_len;           // len to redistribute up to
-  int node_index_final;  // final node index for redistr
-  bool double_list;      // double_list during redistr
+  index_t first_empty;       // first empty spot for slide
+  index_t max_len;           // len to redistribute up to
+  index_t node_index_final;  // final node index for redistr
+  bool double_list;          // double_list during redistr
 } insertion_info_t;
 
+constexpr bool is_null(vertex_t dest) { return dest == NULL_DEST; }
+
+// null overrides sentinel
+constexpr bool is_sentinel(vertex_t dest) { return (dest & SENTINEL_FLAG) && !is_null(dest); }
+
+// id of the node a sentinel belongs to
+constexpr vertex_t sentinel_id(vertex_t dest) { return dest & ~SENTINEL_FLAG; }
+
+// loads a slot or node bound that writers may change meanwhile, for reads validated by the leaf sequence numbers
 template <typename T>
-constexpr bool is_null(T val) {
-  return val == 0;
+inline T load_relaxed(const T &value) {
+  return __atomic_load_n(&value, __ATOMIC_RELAXED);
 }
 
 enum SpecialCases { NEED_GLOBAL_WRITE = -1, NEED_RETRY = -2, EDGE_NOT_FOUND = -3 };
 
+// passed as left_node_bound when lock acquisition starts at the PCSR node of the index itself
+constexpr index_t NO_NODE_BOUND = std::numeric_limits<index_t>::max();
+
+/**
+ * Packed CSR with edge values of type value_t, value_t = void stores an unweighted graph
+ */
+template <typename value_t>
 class PCSR {
  public:
+  typedef typename edge_value<value_t>::type value_type;
+  typedef edge<value_t> edge_t;
+  typedef batch_edge<value_t> batch_edge_t;
+
   // data members
   edge_list_t edges;
+  EdgeValues<value_t> values;
 
-  PCSR(uint32_t init_n, uint32_t, bool lock_search, int domain = 0);
-  PCSR(uint32_t init_n, vector<condition_variable *> *cvs, bool search_lock, int domain = 0);
+  PCSR(vertex_t init_n, vertex_t, bool lock_search, int domain = 0,
+       MemoryBackend memory_backend = MemoryBackend::MALLOC);
+  /**
+   * Builds the PCSR from an edge list: the list is sorted in parallel and every sentinel and edge is written straight
+   * into its final slot of an evenly filled edge array, in one parallel pass over the array
+   * @param src_n number of nodes
+   * @param edge_list edges in any order, the last of several edges with the same endpoints wins, edges with a source
+   * >= src_n are skipped
+   */
+  PCSR(vertex_t src_n, std::vector<batch_edge_t> edge_list, bool lock_search, int domain = 0,
+       MemoryBackend memory_backend = MemoryBackend::MALLOC);
   ~PCSR();
   /** Public API */
-  bool edge_exists(uint32_t src, uint32_t dest);
-  void add_node();
-  void add_edge(uint32_t src, uint32_t dest, uint32_t value);
-  void remove_edge(uint32_t src, uint32_t dest);
-  void read_neighbourhood(int src);
-  vector<int> get_neighbourhood(int src) const;
+  /**
+   * Reads without locking the leaves, see read_optimistically. While other threads change the PCSR the caller has to
+   * be registered with edges.global_lock, otherwise a resize can free the edge array under it.
+   */
+  bool edge_exists(vertex_t src, vertex_t dest);
+  /**
+   * Adds a node, reusing the id of a removed node if there is one
+   * @return id of the node
+   */
+  vertex_t add_node();
+  void add_edge(vertex_t src, vertex_t dest, value_type value = value_type());
+  void remove_edge(vertex_t src, vertex_t dest);
+  /**
+   * Read the neighbourhood of src without locking the leaves like edge_exists, so the caller has to be registered too
+   */
+  void read_neighbourhood(vertex_t src);
+  vector<vertex_t> get_neighbourhood(vertex_t src) const;
+
+  /**
+   * Calls f(dest, value) for every edge of src, in order of dest, straight from the edge array without copying the
+   * neighbourhood. It takes no locks and, unlike get_neighbourhood, doesn't retry if a writer changes the
+   * neighbourhood while f runs.
+   */
+  template <typename F>
+  void for_each_neighbour(vertex_t src, F f) const {
+    if (src >= get_n()) {
+      return;
+    }
+    for (index_t i = nodes[src].beginning + 1; i < nodes[src].end; i++) {
+      const vertex_t dest = edges.dests[i];
+      if (!is_null(dest)) {
+        f(dest, values.get(i));
+      }
+    }
+  }
+
+  /**
+   * Removes all edges of src in one pass over its range of the edge array and rebalances once
+   */
+  void clear_neighbourhood(vertex_t src);
+
+  /**
+   * Removes all edges pointing to dest, scanning the whole edge array in parallel, and rebalances once
+   */
+  void remove_edges_to(vertex_t dest);
+
+  /**
+   * Removes the edges of src and the edges pointing to it, and puts src on the free list for add_node to hand out
+   * again. The sentinel of src stays in place, so until its id is reused src behaves like a node without edges.
+   */
+  void remove_node(vertex_t src);
+
+  /**
+   * Same as remove_node(src), but the edges pointing to the node carry id, which is the id of src outside of this
+   * PCSR if it is a partition of a PPPCSR
+   */
+  void remove_node(vertex_t src, vertex_t id);
+
+  /**
+   * Returns the number of removed nodes whose ids add_node can reuse
+   */
+  size_t get_free_node_count() const { return free_nodes.size(); }
+
+  /**
+   * Inserts a batch of edges, edges that already exist get the value from the batch. The batch is sorted by
+   * (src, dest) and merged into the edge array window by window, so every window is rebalanced once per batch
+   * instead of once per edge. Holds the global lock exclusively for the whole batch.
+   * @param batch edges in any order, the last of several edges with the same endpoints wins, edges with an unknown
+   * source are skipped
+   */
+  void add_edges_batch(std::vector<batch_edge_t> batch);
+
+  /**
+   * Removes a batch of edges. The edges are removed in one sorted pass over the array, rebalancing sparse windows and
+   * shrinking the array are deferred to the end of the batch. Holds the global lock exclusively for the whole batch.
+   * @param batch {src, dest} pairs in any order, missing edges are skipped
+   */
+  void remove_edges_batch(std::vector<std::pair<vertex_t, vertex_t>> batch);
+
+  /**
+   * Returns the value of edge {src, dest}
+   * @return edge value, value_type() if the edge doesn't exist
+   */
+  value_type find_value(vertex_t src, vertex_t dest);
 
   /**
    * Returns the node count
@@ -84,81 +285,151 @@ class PCSR {
   uint64_t get_n() const;
 
   /**
-   * inserts nodes and edges at the front ot the data structure
-   * @param nodes
-   * @param new_items
+   * The migration functions below move a contiguous range of nodes with their edges between neighbouring PCSRs, e.g.
+   * the partitions of a PPPCSR. Nodes travel as node_t with beginning and end (exclusive) indexing their edges in the
+   * edge vector and num_neighbors as stored, edges as plain edges without sentinels. Every call holds the global lock
+   * exclusively and rebuilds the edge array once, fixing up all sentinels in the same pass.
+   */
+
+  /**
+   * Inserts nodes and their edges in front of the first node, the ids of the existing nodes grow by nodes.size()
+   * @param nodes nodes to insert, the first one becomes node 0
+   * @param new_edges edges of the nodes
    */
   void insert_nodes_and_edges_front(std::vector<node_t> nodes, std::vector<edge_t> new_edges);
 
   /**
-   * inserts nodes and edges at the end ot the data structure
-   * @param nodes
-   * @param new_items
+   * Appends nodes and their edges behind the last node
+   * @param nodes nodes to insert, the first one gets id get_n()
+   * @param new_edges edges of the nodes
    */
   void insert_nodes_and_edges_back(std::vector<node_t> nodes, std::vector<edge_t> new_edges);
 
   /**
-   * removes nodes and edges at the front ot the data structure
-   * @param num_nodes #nodes to remove
+   * Removes the first num_nodes nodes with their edges, the ids of the remaining nodes shrink by num_nodes. Removed
+   * nodes on the free list are exported as nodes without edges.
+   * @param num_nodes #nodes to remove, at most get_n()
    * @return removed nodes and edges
    */
-  std::pair<std::vector<node_t>, std::vector<edge_t>> remove_nodes_and_edges_front(int num_nodes);
+  std::pair<std::vector<node_t>, std::vector<edge_t>> remove_nodes_and_edges_front(vertex_t num_nodes);
 
   /**
-   * removes nodes and edges at the end ot the data structure
-   * @param num_nodes
+   * Removes the last num_nodes nodes with their edges
+   * @param num_nodes #nodes to remove, at most get_n()
    * @return removed nodes and edges
    */
-  std::pair<std::vector<node_t>, std::vector<edge_t>> remove_nodes_and_edges_back(int num_nodes);
+  std::pair<std::vector<node_t>, std::vector<edge_t>> remove_nodes_and_edges_back(vertex_t num_nodes);
 
   /**
    * Returns a ref. to the node with the given id
    * @return ref. to node
    */
-  node_t &getNode(int id) { return nodes[id]; }
+  node_t &getNode(vertex_t id) { return nodes[id]; }
 
   /**
    * Returns a const ref. to the node with the given id
    * @return const ref. to node
    */
-  const node_t &getNode(int id) const { return nodes[id]; }
+  const node_t &getNode(vertex_t id) const { return nodes[id]; }
 
  private:
   // data members
   std::vector<node_t> nodes;
+  std::vector<vertex_t> free_nodes;  // removed nodes, their ids are handed out again by add_node
   bool lock_bsearch = false;  // true if we lock during binary search
 
-  // members used when parallel redistributing is enabled
-  bool adding_sentinels = false;              // true if we are in the middle of inserting a sentinel node
-  mutex *redistr_mutex;                       // for synchronisation with the redistributing worker threads
-  condition_variable *redistr_cv;             // for synchronisation with the redistributing worker threads
-  vector<mutex *> *redistr_locks;             // for synchronisation with the redistributing worker threads
-  vector<condition_variable *> *redistr_cvs;  // for synchronisation with the redistributing worker threads
-
-  void redistribute(int index, int len);
-  bool got_correct_insertion_index(edge_t ins_edge, uint32_t src, uint32_t index, edge_t elem, int node_index,
-                                   int node_id, uint32_t &max_node);
-  pair<pair<int, int>, insertion_info_t *> acquire_insert_locks(uint32_t index, edge_t elem, uint32_t src,
-                                                                int ins_node_v, uint32_t left_node_bound, int tries);
-  pair<int, int> acquire_remove_locks(uint32_t index, edge_t elem, uint32_t src, int ins_node_v,
-                                      uint32_t left_node_bound);
-  void release_locks(pair<int, int> acquired_locks);
-  void release_locks_no_inc(pair<int, int> acquired_locks);
-  uint32_t find_value(uint32_t src, uint32_t dest);
+  bool adding_sentinels = false;  // true if we are in the middle of inserting a sentinel node
+
+  void redistribute(index_t index, index_t len);
+  /**
+   * Redistributes [index, index + len) with workers threads of the partition's NUMA domain
+   */
+  void redistribute_parallel(index_t index, index_t len, index_t workers);
+  /**
+   * Returns the number of threads worth splitting the work on len slots across, 1 for small ranges
+   */
+  index_t parallel_workers(uint64_t len) const;
+  /**
+   * Drops the edges with unknown sources and sorts the rest by (src, dest) in parallel. Of several edges with the same
+   * endpoints only the last one is kept.
+   */
+  void sort_batch(std::vector<batch_edge_t> &batch) const;
+  /**
+   * Rebalances after removals: shrinks the array if the root fell below its density bound, otherwise redistributes
+   * every leaf of sparse_leaves (ascending) that fell below its bound in the smallest enclosing window that is dense
+   * enough again
+   */
+  void rebalance_sparse_leaves(const vector<index_t> &sparse_leaves);
+  /**
+   * Empties [begin, end), which must not hold sentinels, and appends the leaves that lost elements to sparse_leaves
+   */
+  void clear_range(uint64_t begin, uint64_t end, vector<index_t> &sparse_leaves);
+  /**
+   * Removes all edges pointing to dest with the global lock held, appends the leaves that lost edges to sparse_leaves
+   */
+  void remove_edges_to_locked(vertex_t dest, vector<index_t> &sparse_leaves);
+  /**
+   * Merges count new elements into [index, index + len) and spreads the result evenly over the range. items is sorted
+   * and after[i] is the slot of the element items[i] follows, which has to lie in the range. space is scratch memory.
+   */
+  void merge_window(index_t index, index_t len, const index_t *after, const edge_t *items, size_t count,
+                    vector<edge_t> &space);
+  // min_node and max_node are the first and last PCSR node the caller holds, max_node grows with the nodes it locks
+  bool got_correct_insertion_index(vertex_t src, index_t index, edge_t elem, index_t node_index, index_t node_id,
+                                   index_t min_node, index_t &max_node);
+  pair<pair<int64_t, int64_t>, insertion_info_t *> acquire_insert_locks(index_t index, edge_t elem, vertex_t src,
+                                                                        int ins_node_v, index_t left_node_bound,
+                                                                        int tries);
+  pair<int64_t, int64_t> acquire_remove_locks(index_t index, edge_t elem, vertex_t src, int ins_node_v,
+                                              index_t left_node_bound);
+  void release_locks(pair<int64_t, int64_t> acquired_locks);
+  void release_locks_no_inc(pair<int64_t, int64_t> acquired_locks);
   vector<uint32_t> sparse_matrix_vector_multiplication(std::vector<uint32_t> const &v);
+  /**
+   * Elements a rebuild puts in front of or behind the elements of the array, and the number of elements it drops from
+   * either end. The kept sentinels get id_shift added to their node id, the new sentinels carry their final id.
+   */
+  struct splice_t {
+    std::vector<edge_t> front;
+    uint64_t drop_front = 0;
+    uint64_t drop_back = 0;
+    std::vector<edge_t> back;
+    vertex_t id_shift = 0;
+  };
+  /**
+   * Moves all elements into a new edge array of new_size slots, evenly spread. The elements are copied once, in
+   * parallel for large arrays, so the time spent under the exclusive global lock is a single pass over the array.
+   * nodes has to hold the nodes of the spliced array already, the sentinels fix up their ranges.
+   */
+  void rebuild(uint64_t new_size);
+  void rebuild(uint64_t new_size, const splice_t &splice);
+  /**
+   * Returns the size the array needs for total elements to lie within the density bounds of the root
+   */
+  uint64_t fitting_size(uint64_t total);
+  /**
+   * Copies the edges of nodes [first, first + count) in the migration format of remove_nodes_and_edges_front
+   */
+  std::pair<std::vector<node_t>, std::vector<edge_t>> export_nodes(vertex_t first, vertex_t count) const;
+  /**
+   * Sentinels and edges of nodes in the migration format, the first sentinel carries id first_id
+   */
+  std::vector<edge_t> import_nodes(const std::vector<node_t> &new_nodes, const std::vector<edge_t> &new_edges,
+                                   vertex_t first_id) const;
   void double_list();
   void half_list();
-  int slide_right(int index, uint32_t src);
-  void slide_left(int index, uint32_t src);
-  void add_edge_parallel(uint32_t src, uint32_t dest, uint32_t value, int retries);
-  void insert(uint32_t index, edge_t elem, uint32_t src, insertion_info_t *info);
-  void remove(uint32_t index, const edge_t &elem, uint32_t src);
-  uint32_t get_node_id(uint32_t node_index) const;
+  int slide_right(index_t index, vertex_t src);
+  void slide_left(int64_t index, vertex_t src);
+  void add_edge_parallel(vertex_t src, vertex_t dest, value_type value, int retries);
+  void insert(index_t index, edge_t elem, vertex_t src, insertion_info_t *info);
+  void remove(index_t index, const edge_t &elem, vertex_t src);
+  index_t get_node_id(index_t node_index) const;
+  bool owns_slot(vertex_t src, index_t index) const;
   void print_array();
-  void print_graph(int);
-  pair<double, int> redistr_store(edge_t *space, int index, int len);
-  void fix_sentinel(const edge_t &sentinel, int in);
-  pair<uint32_t, int> binary_search(edge_t *elem, uint32_t start, uint32_t end, bool unlock);
+  void print_graph(vertex_t);
+  pair<double, index_t> redistr_store(edge_t *space, index_t index, index_t len);
+  void fix_sentinel(vertex_t sentinel, index_t in);
+  pair<index_t, int> binary_search(edge_t *elem, index_t start, index_t end, bool unlock);
   void resizeEdgeArray(size_t newSize);
 
   /**
@@ -167,7 +438,7 @@ class PCSR {
    * @param len range length
    * @return #edges in range
    */
-  int count_elems(int index, int len);
+  index_t count_elems(index_t index, index_t len);
   /**
    * Returns true if every neighbourhood is sorted
    * @return sorted
@@ -177,7 +448,7 @@ class PCSR {
    * Returns the total number of stored edges
    * @return #edges
    */
-  int count_total_edges();
+  uint64_t count_total_edges();
   /**
    * Return the memory footprint of this data structure in byte
    * @return memory footprint in byte
@@ -188,17 +459,28 @@ class PCSR {
    * Returns all stored edges
    * @return [{node_id, dest_id, edge_value}]
    */
-  vector<tuple<uint32_t, uint32_t, uint32_t>> get_edges();
+  vector<tuple<vertex_t, vertex_t, value_type>> get_edges();
 
   /**
    * Deletes all edges. The data structure is invalid afterwards
    */
   void clear();
 
-  void nodes_unlock_shared(bool unlock, int start_node, int end_node);
+  void nodes_unlock_shared(bool unlock, index_t start_node, index_t end_node);
+
+  /**
+   * Runs read(beginning, end) on the slots of src without locking them and repeats it until no writer held one of
+   * the leaves src spans while it ran. Does nothing for unknown nodes.
+   */
+  template <typename F>
+  void read_optimistically(vertex_t src, F read) const;
 
   const bool is_numa_available;
   int domain;
+  // backend of the edge array, the counts and the leaf lock table
+  EdgeArrayAllocator allocator;
+  // CPUs of the NUMA domain, bounds the helper threads of parallel redistributions and resizes
+  index_t domain_cpus;
 };
 
 #endif  // PCSR2_PCSR_H
@@ -0,0 +1,144 @@
+/**
+ * @file edgeArrayAllocator.cpp
+ */
+
+#include "edgeArrayAllocator.h"
+
+#include <numa.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+namespace {
+
+constexpr size_t CACHE_LINE_SIZE = 64;
+constexpr size_t HUGE_PAGE_SIZE = size_t(2) << 20;
+
+size_t round_up(size_t bytes, size_t alignment) { return (bytes + alignment - 1) / alignment * alignment; }
+
+void *check_allocation(void *ptr) {
+  if (ptr == nullptr) {
+    std::cout << "Allocation failed. Abort\n";
+    exit(EXIT_FAILURE);
+  }
+  return ptr;
+}
+
+// mapping of bytes (a multiple of the huge page size) that starts at a huge page boundary
+void *map_aligned(size_t bytes) {
+  // over-allocate by one huge page and trim the mapping to the first huge page boundary
+  void *raw = mmap(nullptr, bytes + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED) {
+    return nullptr;
+  }
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(raw);
+  const uintptr_t aligned = round_up(begin, HUGE_PAGE_SIZE);
+  if (aligned != begin) {
+    munmap(raw, aligned - begin);
+  }
+  const size_t tail = begin + HUGE_PAGE_SIZE - aligned;
+  if (tail != 0) {
+    munmap(reinterpret_cast<void *>(aligned + bytes), tail);
+  }
+  return reinterpret_cast<void *>(aligned);
+}
+
+void *map_huge_pages(size_t bytes, bool explicit_pages) {
+  if (explicit_pages) {
+    void *ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), -1, 0);
+    if (ptr != MAP_FAILED) {
+      return ptr;
+    }
+    static std::atomic_bool warned(false);
+    if (!warned.exchange(true)) {
+      std::cout << "No explicit huge pages available (see /proc/sys/vm/nr_hugepages), using transparent huge pages"
+                << std::endl;
+    }
+  }
+  void *ptr = map_aligned(bytes);
+  if (ptr != nullptr) {
+    madvise(ptr, bytes, MADV_HUGEPAGE);
+  }
+  return ptr;
+}
+
+}  // namespace
+
+MemoryBackend parse_memory_backend(const std::string &name) {
+  if (name == "malloc") {
+    return MemoryBackend::MALLOC;
+  }
+  if (name == "thp") {
+    return MemoryBackend::TRANSPARENT_HUGE_PAGES;
+  }
+  if (name == "hugetlb") {
+    return MemoryBackend::EXPLICIT_HUGE_PAGES;
+  }
+  std::cerr << "Unknown memory backend " << name << ", expected malloc, thp or hugetlb" << std::endl;
+  exit(EXIT_FAILURE);
+}
+
+const char *memory_backend_name(MemoryBackend backend) {
+  switch (backend) {
+    case MemoryBackend::TRANSPARENT_HUGE_PAGES:
+      return "thp";
+    case MemoryBackend::EXPLICIT_HUGE_PAGES:
+      return "hugetlb";
+    default:
+      return "malloc";
+  }
+}
+
+EdgeArrayAllocator::EdgeArrayAllocator(MemoryBackend backend, int domain)
+    : backend(backend), use_numa(domain >= 0 && numa_available() >= 0), domain(domain) {}
+
+bool EdgeArrayAllocator::uses_huge_pages(size_t bytes) const {
+  return backend != MemoryBackend::MALLOC && bytes >= HUGE_PAGE_SIZE;
+}
+
+void *EdgeArrayAllocator::allocate_bytes(size_t bytes) const {
+  if (uses_huge_pages(bytes)) {
+    const size_t len = round_up(bytes, HUGE_PAGE_SIZE);
+    void *ptr = check_allocation(map_huge_pages(len, backend == MemoryBackend::EXPLICIT_HUGE_PAGES));
+    if (use_numa) {
+      // binds the pages before they are touched for the first time
+      numa_tonode_memory(ptr, len, domain);
+    }
+    return ptr;
+  }
+  if (use_numa) {
+    // numa_alloc_onnode hands out whole pages
+    return check_allocation(numa_alloc_onnode(bytes, domain));
+  }
+  return check_allocation(aligned_alloc(CACHE_LINE_SIZE, round_up(std::max<size_t>(bytes, 1), CACHE_LINE_SIZE)));
+}
+
+void *EdgeArrayAllocator::reallocate_bytes(void *ptr, size_t old_bytes, size_t new_bytes) const {
+  if (!uses_huge_pages(old_bytes) && !uses_huge_pages(new_bytes) && use_numa) {
+    return check_allocation(numa_realloc(ptr, old_bytes, new_bytes));
+  }
+  void *new_ptr = allocate_bytes(new_bytes);
+  memcpy(new_ptr, ptr, std::min(old_bytes, new_bytes));
+  release_bytes(ptr, old_bytes);
+  return new_ptr;
+}
+
+void EdgeArrayAllocator::release_bytes(void *ptr, size_t bytes) const {
+  if (uses_huge_pages(bytes)) {
+    munmap(ptr, round_up(bytes, HUGE_PAGE_SIZE));
+  } else if (use_numa) {
+    numa_free(ptr, bytes);
+  } else {
+    free(ptr);
+  }
+}
@@ -0,0 +1,67 @@
+/**
+ * @file edgeArrayAllocator.h
+ * Allocation backends for the edge array, its occupancy counts and the leaf lock table of a PCSR
+ */
+
+#ifndef PARALLEL_PACKED_CSR_EDGEARRAYALLOCATOR_H
+#define PARALLEL_PACKED_CSR_EDGEARRAYALLOCATOR_H
+
+#include <cstddef>
+#include <string>
+
+enum class MemoryBackend {
+  MALLOC,                  // cache-line-aligned heap memory, numa_alloc_onnode on a NUMA node
+  TRANSPARENT_HUGE_PAGES,  // 2 MB aligned anonymous mapping advised to be backed by transparent huge pages
+  EXPLICIT_HUGE_PAGES      // 2 MB pages from the hugetlbfs pool, falls back to transparent huge pages if it is empty
+};
+
+/**
+ * Parses the name of a backend as given on the command line (malloc, thp or hugetlb), aborts on unknown names
+ */
+MemoryBackend parse_memory_backend(const std::string &name);
+
+/**
+ * Returns the command line name of a backend
+ */
+const char *memory_backend_name(MemoryBackend backend);
+
+/**
+ * Allocates arrays with a given backend, on the given NUMA node if domain >= 0.
+ * All arrays are at least cache-line-aligned, so leaves never straddle a cache line more than necessary.
+ * Arrays smaller than a huge page always come from the MALLOC backend.
+ */
+class EdgeArrayAllocator {
+ public:
+  EdgeArrayAllocator(MemoryBackend backend, int domain);
+
+  template <typename T>
+  T *allocate(size_t count) const {
+    return static_cast<T *>(allocate_bytes(count * sizeof(T)));
+  }
+
+  // the contents up to min(old_count, new_count) are preserved
+  template <typename T>
+  T *reallocate(T *ptr, size_t old_count, size_t new_count) const {
+    return static_cast<T *>(reallocate_bytes(ptr, old_count * sizeof(T), new_count * sizeof(T)));
+  }
+
+  // count has to be the count the array was allocated with
+  template <typename T>
+  void release(T *ptr, size_t count) const {
+    release_bytes(ptr, count * sizeof(T));
+  }
+
+  MemoryBackend get_backend() const { return backend; }
+
+ private:
+  void *allocate_bytes(size_t bytes) const;
+  void *reallocate_bytes(void *ptr, size_t old_bytes, size_t new_bytes) const;
+  void release_bytes(void *ptr, size_t bytes) const;
+  bool uses_huge_pages(size_t bytes) const;
+
+  MemoryBackend backend;
+  bool use_numa;
+  int domain;
+};
+
+#endif  // PARALLEL_PACKED_CSR_EDGEARRAYALLOCATOR_H
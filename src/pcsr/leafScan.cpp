@@ -0,0 +1,164 @@
+/**
+ * @file leafScan.cpp
+ */
+
+#include "leafScan.h"
+
+#include <immintrin.h>
+
+#include "PCSR.h"
+
+namespace {
+
+typedef leaf_masks (*scan_leaf_fn)(const vertex_t *, size_t, vertex_t);
+
+leaf_masks scan_leaf_scalar(const vertex_t *dests, size_t len, vertex_t key) {
+  leaf_masks m{0, 0};
+  for (size_t i = 0; i < len; i++) {
+    m.occupied |= uint64_t(!is_null(dests[i])) << i;
+    m.less |= uint64_t(dests[i] < key) << i;
+  }
+  return m;
+}
+
+// The vector versions handle whole vectors and leave the remaining slots to the scalar loop. Empty slots hold the
+// largest representable value, so they never compare less than the key.
+#ifdef PPCSR_64BIT_IDS
+
+__attribute__((target("avx512f"))) leaf_masks scan_leaf_avx512(const vertex_t *dests, size_t len, vertex_t key) {
+  const __m512i k = _mm512_set1_epi64(key);
+  const __m512i null = _mm512_set1_epi64(-1);
+  leaf_masks m{0, 0};
+  for (size_t i = 0; i < len; i += 8) {
+    // masked load, lanes past the end are neither read nor reported
+    const __mmask8 lanes = (len - i >= 8) ? 0xFF : (1u << (len - i)) - 1;
+    const __m512i v = _mm512_maskz_loadu_epi64(lanes, dests + i);
+    m.occupied |= uint64_t(_mm512_mask_cmpneq_epu64_mask(lanes, v, null)) << i;
+    m.less |= uint64_t(_mm512_mask_cmplt_epu64_mask(lanes, v, k)) << i;
+  }
+  return m;
+}
+
+__attribute__((target("avx2"))) leaf_masks scan_leaf_avx2(const vertex_t *dests, size_t len, vertex_t key) {
+  // there is no unsigned 64-bit compare, flipping the sign bit maps it onto the signed one
+  const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+  const __m256i k = _mm256_xor_si256(_mm256_set1_epi64x(key), sign);
+  const __m256i null = _mm256_set1_epi64x(-1);
+  leaf_masks m{0, 0};
+  size_t i = 0;
+  for (; i + 4 <= len; i += 4) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dests + i));
+    const __m256i lt = _mm256_cmpgt_epi64(k, _mm256_xor_si256(v, sign));
+    const __m256i empty = _mm256_cmpeq_epi64(v, null);
+    m.occupied |= uint64_t(~_mm256_movemask_pd(_mm256_castsi256_pd(empty)) & 0xF) << i;
+    m.less |= uint64_t(_mm256_movemask_pd(_mm256_castsi256_pd(lt))) << i;
+  }
+  const leaf_masks tail = scan_leaf_scalar(dests + i, len - i, key);
+  m.occupied |= tail.occupied << i;
+  m.less |= tail.less << i;
+  return m;
+}
+
+__attribute__((target("sse4.2"))) leaf_masks scan_leaf_sse(const vertex_t *dests, size_t len, vertex_t key) {
+  const __m128i sign = _mm_set1_epi64x(INT64_MIN);
+  const __m128i k = _mm_xor_si128(_mm_set1_epi64x(key), sign);
+  const __m128i null = _mm_set1_epi64x(-1);
+  leaf_masks m{0, 0};
+  size_t i = 0;
+  for (; i + 2 <= len; i += 2) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dests + i));
+    const __m128i lt = _mm_cmpgt_epi64(k, _mm_xor_si128(v, sign));
+    const __m128i empty = _mm_cmpeq_epi64(v, null);
+    m.occupied |= uint64_t(~_mm_movemask_pd(_mm_castsi128_pd(empty)) & 0x3) << i;
+    m.less |= uint64_t(_mm_movemask_pd(_mm_castsi128_pd(lt))) << i;
+  }
+  const leaf_masks tail = scan_leaf_scalar(dests + i, len - i, key);
+  m.occupied |= tail.occupied << i;
+  m.less |= tail.less << i;
+  return m;
+}
+
+#else
+
+__attribute__((target("avx512f"))) leaf_masks scan_leaf_avx512(const vertex_t *dests, size_t len, vertex_t key) {
+  const __m512i k = _mm512_set1_epi32(key);
+  const __m512i null = _mm512_set1_epi32(-1);
+  leaf_masks m{0, 0};
+  for (size_t i = 0; i < len; i += 16) {
+    // masked load, lanes past the end are neither read nor reported
+    const __mmask16 lanes = (len - i >= 16) ? 0xFFFF : (1u << (len - i)) - 1;
+    const __m512i v = _mm512_maskz_loadu_epi32(lanes, dests + i);
+    m.occupied |= uint64_t(_mm512_mask_cmpneq_epu32_mask(lanes, v, null)) << i;
+    m.less |= uint64_t(_mm512_mask_cmplt_epu32_mask(lanes, v, k)) << i;
+  }
+  return m;
+}
+
+__attribute__((target("avx2"))) leaf_masks scan_leaf_avx2(const vertex_t *dests, size_t len, vertex_t key) {
+  const __m256i k = _mm256_set1_epi32(key);
+  const __m256i null = _mm256_set1_epi32(-1);
+  leaf_masks m{0, 0};
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dests + i));
+    // v >= key iff max(v, key) == v
+    const __m256i ge = _mm256_cmpeq_epi32(_mm256_max_epu32(v, k), v);
+    const __m256i empty = _mm256_cmpeq_epi32(v, null);
+    m.occupied |= uint64_t(~_mm256_movemask_ps(_mm256_castsi256_ps(empty)) & 0xFF) << i;
+    m.less |= uint64_t(~_mm256_movemask_ps(_mm256_castsi256_ps(ge)) & 0xFF) << i;
+  }
+  const leaf_masks tail = scan_leaf_scalar(dests + i, len - i, key);
+  m.occupied |= tail.occupied << i;
+  m.less |= tail.less << i;
+  return m;
+}
+
+__attribute__((target("sse4.2"))) leaf_masks scan_leaf_sse(const vertex_t *dests, size_t len, vertex_t key) {
+  const __m128i k = _mm_set1_epi32(key);
+  const __m128i null = _mm_set1_epi32(-1);
+  leaf_masks m{0, 0};
+  size_t i = 0;
+  for (; i + 4 <= len; i += 4) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dests + i));
+    const __m128i ge = _mm_cmpeq_epi32(_mm_max_epu32(v, k), v);
+    const __m128i empty = _mm_cmpeq_epi32(v, null);
+    m.occupied |= uint64_t(~_mm_movemask_ps(_mm_castsi128_ps(empty)) & 0xF) << i;
+    m.less |= uint64_t(~_mm_movemask_ps(_mm_castsi128_ps(ge)) & 0xF) << i;
+  }
+  const leaf_masks tail = scan_leaf_scalar(dests + i, len - i, key);
+  m.occupied |= tail.occupied << i;
+  m.less |= tail.less << i;
+  return m;
+}
+
+#endif
+
+struct scan_leaf_impl {
+  scan_leaf_fn fn;
+  const char *isa;
+};
+
+scan_leaf_impl select_scan_leaf() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return {scan_leaf_avx512, "avx512"};
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return {scan_leaf_avx2, "avx2"};
+  }
+  if (__builtin_cpu_supports("sse4.2")) {
+    return {scan_leaf_sse, "sse4.2"};
+  }
+  return {scan_leaf_scalar, "scalar"};
+}
+
+const scan_leaf_impl &get_scan_leaf() {
+  static const scan_leaf_impl impl = select_scan_leaf();
+  return impl;
+}
+
+}  // namespace
+
+leaf_masks scan_leaf(const vertex_t *dests, size_t len, vertex_t key) { return get_scan_leaf().fn(dests, len, key); }
+
+const char *scan_leaf_isa() { return get_scan_leaf().isa; }
@@ -0,0 +1,35 @@
+/**
+ * @file leafScan.h
+ * Vectorized scan of a short range of the edge array, used by PCSR::binary_search once the search window fits into a
+ * leaf
+ */
+
+#ifndef PARALLEL_PACKED_CSR_LEAFSCAN_H
+#define PARALLEL_PACKED_CSR_LEAFSCAN_H
+
+#include <types.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// longest range scan_leaf accepts, leaves never get larger than this (logN <= 64)
+constexpr size_t LEAF_SCAN_MAX_LEN = 64;
+
+/** Bit i of each mask describes slot i of the scanned range */
+struct leaf_masks {
+  uint64_t occupied;  // slot holds an edge or a sentinel
+  uint64_t less;      // slot holds a destination smaller than the key (never set for empty slots)
+};
+
+/**
+ * Compares the slots dests[0, len) against key, len <= LEAF_SCAN_MAX_LEN.
+ * Uses AVX-512, AVX2 or SSE4.2 if the CPU supports it and falls back to scalar code otherwise.
+ */
+leaf_masks scan_leaf(const vertex_t *dests, size_t len, vertex_t key);
+
+/**
+ * Returns the name of the implementation scan_leaf dispatches to on this CPU
+ */
+const char *scan_leaf_isa();
+
+#endif  // PARALLEL_PACKED_CSR_LEAFSCAN_H
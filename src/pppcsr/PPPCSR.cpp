@@ -7,65 +7,318 @@
 
 #include <numa.h>
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <thread>
 
-PPPCSR::PPPCSR(uint32_t init_n, uint32_t src_n, bool lock_search, int numDomain, int partitionsPerDomain, bool use_numa)
-    : partitionsPerDomain(partitionsPerDomain) {
-  std::size_t numDomains = numDomain;
+Partitioning parse_partitioning(const std::string &name) {
+  if (name == "range") {
+    return Partitioning::RANGE;
+  }
+  if (name == "hash") {
+    return Partitioning::HASH;
+  }
+  if (name == "degree") {
+    return Partitioning::DEGREE;
+  }
+  std::cerr << "Unknown partitioning " << name << ", expected range, hash or degree" << std::endl;
+  exit(EXIT_FAILURE);
+}
+
+const char *partitioning_name(Partitioning partitioning) {
+  switch (partitioning) {
+    case Partitioning::HASH:
+      return "hash";
+    case Partitioning::DEGREE:
+      return "degree";
+    default:
+      return "range";
+  }
+}
+
+template <typename value_t>
+PPPCSR<value_t>::PPPCSR(vertex_t init_n, vertex_t src_n, bool lock_search, int numDomain, int partitionsPerDomain, bool use_numa,
+                        MemoryBackend memory_backend, Partitioning partitioning)
+    : partitionsPerDomain(partitionsPerDomain), use_numa(use_numa), partitioning(partitioning) {
+  const std::vector<vertex_t> sizes = split_vertices(init_n, numDomain, std::vector<batch_edge_t>());
+  partitions.reserve(sizes.size());
+  for (std::size_t p = 0; p < sizes.size(); p++) {
+    const int domain = (use_numa) ? static_cast<int>(p / partitionsPerDomain) : -1;
+    partitions.emplace_back(sizes[p], sizes[p], lock_search, domain, memory_backend);
+  }
+  states.reset(new partition_state[partitions.size()]);
+  cout << "Number of partitions: " << partitions.size() << std::endl;
+}
+
+template <typename value_t>
+PPPCSR<value_t>::PPPCSR(vertex_t init_n, std::vector<batch_edge_t> edge_list, bool lock_search, int numDomain,
+                        int partitionsPerDomain, bool use_numa, MemoryBackend memory_backend,
+                        Partitioning partitioning)
+    : partitionsPerDomain(partitionsPerDomain), use_numa(use_numa), partitioning(partitioning) {
+  const std::vector<vertex_t> sizes = split_vertices(init_n, numDomain, edge_list);
+  std::vector<std::vector<batch_edge_t>> pieces(sizes.size());
+  for (batch_edge_t &e : edge_list) {
+    if (e.src < init_n) {
+      const std::size_t p = get_partiton(e.src);
+      e.src = to_local(p, e.src);
+      pieces[p].push_back(e);
+    }
+  }
+  edge_list = std::vector<batch_edge_t>();
+
+  // every partition builds itself with the threads of its domain
+  partitions.reserve(sizes.size());
+  for (std::size_t p = 0; p < sizes.size(); p++) {
+    const int domain = (use_numa) ? static_cast<int>(p / partitionsPerDomain) : -1;
+    partitions.emplace_back(sizes[p], std::move(pieces[p]), lock_search, domain, memory_backend);
+  }
+  states.reset(new partition_state[partitions.size()]);
+  cout << "Number of partitions: " << partitions.size() << std::endl;
+}
 
-  partitions.reserve(numDomains * partitionsPerDomain);
-  distribution.reserve(numDomains * partitionsPerDomain);
-  distribution.push_back(0);
+template <typename value_t>
+PPPCSR<value_t>::~PPPCSR() {
+  stop_rebalancer();
+}
+
+template <typename value_t>
+std::vector<vertex_t> PPPCSR<value_t>::split_vertices(vertex_t init_n, std::size_t numDomains,
+                                                      const std::vector<batch_edge_t> &core_graph) {
+  std::vector<vertex_t> sizes;
+  std::vector<size_t> starts;
+  sizes.reserve(numDomains * partitionsPerDomain);
+  starts.reserve(numDomains * partitionsPerDomain);
+  starts.push_back(0);
   size_t partitionSize = std::ceil(init_n / (numDomains * partitionsPerDomain));
 
   for (std::size_t i = 0; i < numDomains; i++) {
     for (std::size_t p = 0; p < partitionsPerDomain; p++) {
       if (i > 0 || p > 0) {
-        distribution.push_back(distribution.back() + partitionSize);
+        starts.push_back(starts.back() + partitionSize);
       }
       if (i == numDomains - 1 && p == partitionsPerDomain - 1) {
         partitionSize = init_n - ((i * partitionsPerDomain) + p) * partitionSize;
       }
-      partitions.emplace_back(partitionSize, partitionSize, lock_search, (use_numa) ? i : -1);
+      sizes.push_back(partitionSize);
     }
   }
-  cout << "Number of partitions: " << partitions.size() << std::endl;
+
+  const std::size_t num_partitions = sizes.size();
+  if (partitioning == Partitioning::HASH) {
+    // partition p holds the ids p, p + num_partitions, p + 2 * num_partitions, ...
+    for (std::size_t p = 0; p < num_partitions; p++) {
+      starts[p] = 0;
+      sizes[p] = (init_n + num_partitions - 1 - p) / num_partitions;
+    }
+  } else if (partitioning == Partitioning::DEGREE) {
+    // a vertex weighs one element for its sentinel plus one per edge, boundary k goes to the first vertex that has at
+    // least k / num_partitions of the total weight in front of it
+    std::vector<uint64_t> weights(init_n, 1);
+    uint64_t total = init_n;
+    for (const batch_edge_t &e : core_graph) {
+      if (e.src < init_n) {
+        weights[e.src]++;
+        total++;
+      }
+    }
+    std::size_t k = 1;
+    uint64_t cumulative = 0;
+    for (vertex_t v = 0; v < init_n && k < num_partitions; v++) {
+      while (k < num_partitions && cumulative * num_partitions >= k * total) {
+        starts[k++] = v;
+      }
+      cumulative += weights[v];
+    }
+    for (; k < num_partitions; k++) {
+      starts[k] = init_n;
+    }
+    for (std::size_t p = 0; p < num_partitions; p++) {
+      sizes[p] = ((p + 1 < num_partitions) ? starts[p + 1] : init_n) - starts[p];
+    }
+  }
+
+  distribution = std::vector<std::atomic<size_t>>(starts.size());
+  for (std::size_t p = 0; p < starts.size(); p++) {
+    distribution[p].store(starts[p]);
+  }
+  // every range partition but the last one has the size of the first one
+  uniform_partition_size.store((partitioning == Partitioning::RANGE) ? sizes.front() : 0);
+  return sizes;
 }
 
-bool PPPCSR::edge_exists(uint32_t src, uint32_t dest) {
-  return partitions[get_partiton(src)].edge_exists(src - distribution[get_partiton(src)], dest);
+template <typename value_t>
+bool PPPCSR<value_t>::edge_exists(vertex_t src, vertex_t dest) {
+  return route(src, NO_PARTITION,
+               [&](std::size_t p, vertex_t local) { return partitions[p].edge_exists(local, dest); });
 }
 
-vector<int> PPPCSR::get_neighbourhood(int src) const {
-  return partitions[get_partiton(src)].get_neighbourhood(src - distribution[get_partiton(src)]);
+template <typename value_t>
+vector<vertex_t> PPPCSR<value_t>::get_neighbourhood(vertex_t src) const {
+  return route(src, NO_PARTITION,
+               [&](std::size_t p, vertex_t local) { return partitions[p].get_neighbourhood(local); });
 }
 
-void PPPCSR::add_node() { partitions.back().add_node(); }
+template <typename value_t>
+vertex_t PPPCSR<value_t>::add_node() {
+  const std::lock_guard<std::mutex> lck(migration_mutex);
+  // ids of removed nodes first, new ids are appended to the last partition
+  std::size_t p = 0;
+  while (p + 1 < partitions.size() && partitions[p].get_free_node_count() == 0) {
+    p++;
+  }
+  if (partitioning == Partitioning::HASH && partitions[p].get_free_node_count() == 0) {
+    // the next id is the node count, its partition holds exactly the ids below it
+    uint64_t n = 0;
+    for (const PCSR<value_t> &partition : partitions) {
+      n += partition.get_n();
+    }
+    p = n % partitions.size();
+  }
+  FastLock &lock = *partitions[p].edges.global_lock;
+  lock.registerThread();
+  const Registration registration(lock);
+  return to_global(p, partitions[p].add_node());
+}
 
-void PPPCSR::add_edge(uint32_t src, uint32_t dest, uint32_t value) {
-  partitions[get_partiton(src)].add_edge(src - distribution[get_partiton(src)], dest, value);
+template <typename value_t>
+void PPPCSR<value_t>::clear_neighbourhood(vertex_t src) {
+  route(src, NO_PARTITION, [&](std::size_t p, vertex_t local) { partitions[p].clear_neighbourhood(local); });
 }
 
-void PPPCSR::remove_edge(uint32_t src, uint32_t dest) {
-  partitions[get_partiton(src)].remove_edge(src - distribution[get_partiton(src)], dest);
+template <typename value_t>
+void PPPCSR<value_t>::remove_node(vertex_t src) {
+  const std::lock_guard<std::mutex> lck(migration_mutex);
+  const std::size_t owner = get_partiton(src);
+  // the edges pointing to src may live in any partition
+  for_each_partition([](std::size_t) { return true; },
+                     [&](std::size_t p) {
+                       if (p == owner) {
+                         partitions[p].remove_node(to_local(p, src), src);
+                       } else {
+                         partitions[p].remove_edges_to(src);
+                       }
+                     });
 }
 
-void PPPCSR::read_neighbourhood(int src) {
-  partitions[get_partiton(src)].read_neighbourhood(src - distribution[get_partiton(src)]);
+template <typename value_t>
+void PPPCSR<value_t>::add_edge(vertex_t src, vertex_t dest, value_type value, std::size_t partition_hint) {
+  route(src, partition_hint, [&](std::size_t p, vertex_t local) {
+    states[p].updates.fetch_add(1, std::memory_order_relaxed);
+    partitions[p].add_edge(local, dest, value);
+  });
 }
 
-std::size_t PPPCSR::get_partiton(size_t vertex_id) const {
-  for (std::size_t i = 1; i < distribution.size(); i++) {
-    if (distribution[i] > vertex_id) {
-      return i - 1;
+template <typename value_t>
+template <typename P, typename F>
+void PPPCSR<value_t>::for_each_partition(P selected, F fn) {
+  std::vector<std::thread> threads;
+  for (std::size_t p = 0; p < partitions.size(); p++) {
+    if (!selected(p)) {
+      continue;
     }
+    threads.emplace_back([this, p, &fn] {
+      run_on_domain_of(p);
+      FastLock &lock = *partitions[p].edges.global_lock;
+      lock.registerThread();
+      const Registration registration(lock);
+      fn(p);
+    });
+  }
+  for (std::thread &t : threads) {
+    t.join();
+  }
+}
+
+template <typename value_t>
+template <typename T, typename F>
+void PPPCSR<value_t>::apply_partitioned(std::vector<T> batch, vertex_t T::*src, F apply) {
+  const std::lock_guard<std::mutex> lck(migration_mutex);
+  std::vector<std::vector<T>> pieces(partitions.size());
+  for (T &e : batch) {
+    const std::size_t p = get_partiton(e.*src);
+    e.*src = to_local(p, e.*src);
+    pieces[p].push_back(e);
+  }
+  batch = std::vector<T>();
+
+  for_each_partition([&pieces](std::size_t p) { return !pieces[p].empty(); },
+                     [&](std::size_t p) { apply(partitions[p], std::move(pieces[p])); });
+}
+
+template <typename value_t>
+void PPPCSR<value_t>::add_edges_batch(std::vector<batch_edge_t> batch) {
+  apply_partitioned(std::move(batch), &batch_edge_t::src,
+                    [](PCSR<value_t> &partition, std::vector<batch_edge_t> piece) {
+                      partition.add_edges_batch(std::move(piece));
+                    });
+}
+
+template <typename value_t>
+void PPPCSR<value_t>::remove_edges_batch(std::vector<std::pair<vertex_t, vertex_t>> batch) {
+  apply_partitioned(std::move(batch), &std::pair<vertex_t, vertex_t>::first,
+                    [](PCSR<value_t> &partition, std::vector<std::pair<vertex_t, vertex_t>> piece) {
+                      partition.remove_edges_batch(std::move(piece));
+                    });
+}
+
+template <typename value_t>
+void PPPCSR<value_t>::remove_edge(vertex_t src, vertex_t dest, std::size_t partition_hint) {
+  route(src, partition_hint, [&](std::size_t p, vertex_t local) {
+    states[p].updates.fetch_add(1, std::memory_order_relaxed);
+    partitions[p].remove_edge(local, dest);
+  });
+}
+
+template <typename value_t>
+void PPPCSR<value_t>::read_neighbourhood(vertex_t src, std::size_t partition_hint) {
+  route(src, partition_hint, [&](std::size_t p, vertex_t local) { partitions[p].read_neighbourhood(local); });
+}
+
+template <typename value_t>
+std::size_t PPPCSR<value_t>::get_partiton(size_t vertex_id) const {
+  if (partitioning == Partitioning::HASH) {
+    return vertex_id % distribution.size();
+  }
+  // Relaxed loads are enough: a lookup that races with a boundary move may return a neighbour of the owner, route
+  // checks the result against the boundaries before it uses it.
+  const size_t partition_size = uniform_partition_size.load(std::memory_order_relaxed);
+  if (partition_size != 0) {
+    return std::min<std::size_t>(vertex_id / partition_size, distribution.size() - 1);
+  }
+  // last partition whose start is <= vertex_id (distribution[0] is 0), the loop runs log2(#partitions) times
+  // regardless of vertex_id and the comparison compiles to a conditional move
+  const std::atomic<size_t> *base = distribution.data();
+  std::size_t n = distribution.size();
+  while (n > 1) {
+    const std::size_t half = n / 2;
+    base = (base[half].load(std::memory_order_relaxed) <= vertex_id) ? base + half : base;
+    n -= half;
   }
-  // Return last partition
-  return distribution.size() - 1;
+  return base - distribution.data();
+}
+
+template <typename value_t>
+bool PPPCSR<value_t>::owns(std::size_t p, vertex_t src) const {
+  if (partitioning == Partitioning::HASH) {
+    return src % distribution.size() == p;
+  }
+  return src >= distribution[p].load() && (p + 1 == distribution.size() || src < distribution[p + 1].load());
+}
+
+template <typename value_t>
+vertex_t PPPCSR<value_t>::to_local(std::size_t p, vertex_t id) const {
+  return (partitioning == Partitioning::HASH) ? id / distribution.size() : id - distribution[p].load();
+}
+
+template <typename value_t>
+vertex_t PPPCSR<value_t>::to_global(std::size_t p, vertex_t local) const {
+  return (partitioning == Partitioning::HASH) ? local * distribution.size() + p : distribution[p].load() + local;
 }
 
-uint64_t PPPCSR::get_n() {
+template <typename value_t>
+uint64_t PPPCSR<value_t>::get_n() {
+  const std::lock_guard<std::mutex> lck(migration_mutex);
   uint64_t n = 0;
   for (int i = 0; i < partitions.size(); i++) {
     n += partitions[i].get_n();
@@ -73,8 +326,167 @@ uint64_t PPPCSR::get_n() {
   return n;
 }
 
-node_t &PPPCSR::getNode(int id) { return partitions[get_partiton(id)].getNode(id - distribution[get_partiton(id)]); }
+template <typename value_t>
+node_t &PPPCSR<value_t>::getNode(vertex_t id) {
+  return route(id, NO_PARTITION,
+               [&](std::size_t p, vertex_t local) -> node_t & { return partitions[p].getNode(local); });
+}
+
+template <typename value_t>
+const node_t &PPPCSR<value_t>::getNode(vertex_t id) const {
+  return route(id, NO_PARTITION,
+               [&](std::size_t p, vertex_t local) -> const node_t & { return partitions[p].getNode(local); });
+}
+
+template <typename value_t>
+void PPPCSR<value_t>::run_on_domain_of(std::size_t p) const {
+  if (use_numa) {
+    numa_run_on_node(p / partitionsPerDomain);
+  }
+}
+
+template <typename value_t>
+void PPPCSR<value_t>::move_boundary(std::size_t left, vertex_t count, bool to_right) {
+  const std::size_t right = left + 1;
+  // the boundaries stop being evenly spaced, lookups fall back to the search
+  uniform_partition_size.store(0);
+  states[left].migrating.store(true);
+  states[right].migrating.store(true);
+  // threads that registered before the flags were set finish their operation, later ones back off
+  partitions[left].edges.global_lock->waitUnregistered();
+  partitions[right].edges.global_lock->waitUnregistered();
+
+  // each partition rebuilds its edge array on its own domain
+  const std::size_t from = to_right ? left : right;
+  const std::size_t to = to_right ? right : left;
+  run_on_domain_of(from);
+  auto moved = to_right ? partitions[from].remove_nodes_and_edges_back(count)
+                        : partitions[from].remove_nodes_and_edges_front(count);
+  run_on_domain_of(to);
+  if (to_right) {
+    partitions[to].insert_nodes_and_edges_front(std::move(moved.first), std::move(moved.second));
+    distribution[right].fetch_sub(count);
+  } else {
+    partitions[to].insert_nodes_and_edges_back(std::move(moved.first), std::move(moved.second));
+    distribution[right].fetch_add(count);
+  }
+  if (use_numa) {
+    numa_run_on_node(-1);
+  }
+
+  states[left].migrating.store(false);
+  states[right].migrating.store(false);
+}
+
+template <typename value_t>
+bool PPPCSR<value_t>::rebalance(double tolerance) {
+  const std::lock_guard<std::mutex> lck(migration_mutex);
+  const std::size_t num_partitions = partitions.size();
+  if (num_partitions < 2 || partitioning == Partitioning::HASH) {
+    return false;
+  }
+
+  // sample the partitions: vertices, elements (edges and sentinels) and updates since the last round
+  std::vector<uint64_t> vertices(num_partitions);
+  std::vector<uint64_t> elements(num_partitions);
+  std::vector<uint64_t> updates(num_partitions);
+  uint64_t total_elements = 0;
+  uint64_t total_updates = 0;
+  for (std::size_t p = 0; p < num_partitions; p++) {
+    FastLock &lock = *partitions[p].edges.global_lock;
+    lock.registerThread();
+    // the count tree can only be replaced by a resize, which waits for registered threads past lock_shared
+    lock.lock_shared();
+    vertices[p] = partitions[p].get_n();
+    elements[p] = partitions[p].edges.counts[1].load();
+    lock.unlock_shared();
+    lock.unregisterThread();
+    updates[p] = states[p].updates.exchange(0, std::memory_order_relaxed);
+    total_elements += elements[p];
+    total_updates += updates[p];
+  }
+  if (total_elements == 0) {
+    return false;
+  }
+
+  // share of the load of every partition, size and update rate weigh the same
+  std::vector<double> share(num_partitions);
+  for (std::size_t p = 0; p < num_partitions; p++) {
+    share[p] = static_cast<double>(elements[p]) / total_elements;
+    if (total_updates > 0) {
+      share[p] = (share[p] + static_cast<double>(updates[p]) / total_updates) / 2;
+    }
+  }
+  if (*std::max_element(share.begin(), share.end()) <= (1 + tolerance) / num_partitions) {
+    return false;
+  }
+
+  // Boundary k ideally sits where the cumulative share reaches k / num_partitions. The load is assumed to be spread
+  // evenly over the vertices of a partition, repeated rounds correct the estimate as the partitions shrink.
+  std::vector<size_t> boundaries(num_partitions);
+  std::vector<size_t> targets(num_partitions);
+  double cumulative = 0;
+  std::size_t p = 0;
+  for (std::size_t k = 1; k < num_partitions; k++) {
+    const double goal = static_cast<double>(k) / num_partitions;
+    while (p + 1 < num_partitions && cumulative + share[p] < goal) {
+      cumulative += share[p];
+      p++;
+    }
+    const double fraction = (share[p] > 0) ? std::min(1.0, (goal - cumulative) / share[p]) : 0;
+    targets[k] = distribution[p].load() + static_cast<size_t>(fraction * vertices[p]);
+    boundaries[k] = distribution[k].load();
+  }
+
+  bool moved = false;
+  for (std::size_t k = 1; k < num_partitions; k++) {
+    // take at most half of the vertices of the partition that gives them away
+    const bool to_right = targets[k] < boundaries[k];
+    const vertex_t count = to_right ? std::min<uint64_t>(boundaries[k] - targets[k], vertices[k - 1] / 2)
+                                    : std::min<uint64_t>(targets[k] - boundaries[k], vertices[k] / 2);
+    if (count == 0) {
+      continue;
+    }
+    move_boundary(k - 1, count, to_right);
+    if (to_right) {
+      vertices[k - 1] -= count;
+      vertices[k] += count;
+    } else {
+      vertices[k - 1] += count;
+      vertices[k] -= count;
+    }
+    moved = true;
+  }
+  return moved;
+}
+
+template <typename value_t>
+void PPPCSR<value_t>::start_rebalancer(std::chrono::milliseconds interval, double tolerance) {
+  stop_rebalancer();
+  stop_rebalancing = false;
+  rebalancer = std::thread([this, interval, tolerance] {
+    const auto slice = std::min(interval, std::chrono::milliseconds(10));
+    auto next = std::chrono::steady_clock::now() + interval;
+    while (!stop_rebalancing) {
+      std::this_thread::sleep_for(slice);
+      if (std::chrono::steady_clock::now() >= next) {
+        rebalance(tolerance);
+        next = std::chrono::steady_clock::now() + interval;
+      }
+    }
+  });
+}
 
-const node_t &PPPCSR::getNode(int id) const {
-  return partitions[get_partiton(id)].getNode(id - distribution[get_partiton(id)]);
+template <typename value_t>
+void PPPCSR<value_t>::stop_rebalancer() {
+  if (rebalancer.joinable()) {
+    stop_rebalancing = true;
+    rebalancer.join();
+  }
 }
+
+template class PPPCSR<void>;
+template class PPPCSR<uint32_t>;
+template class PPPCSR<uint64_t>;
+template class PPPCSR<float>;
+template class PPPCSR<double>;
@@ -3,29 +3,139 @@
  * @author Christian Menges
  */
 
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
 #include "../pcsr/PCSR.h"
 
 #ifndef PPPCSR_H
 #define PPPCSR_H
 
+/**
+ * Assignment of vertices to the partitions of a PPPCSR
+ */
+enum class Partitioning {
+  RANGE,  // contiguous id ranges of equal length, the last partition takes the rest and all added nodes
+  HASH,   // vertex v lives in partition v mod #partitions, consecutive and newly added ids spread over all partitions
+  DEGREE  // contiguous id ranges that hold about the same number of vertices plus edges of the core graph
+};
+
+/**
+ * Parses the name of a partitioning as given on the command line (range, hash or degree), aborts on unknown names
+ */
+Partitioning parse_partitioning(const std::string &name);
+
+/**
+ * Returns the command line name of a partitioning
+ */
+const char *partitioning_name(Partitioning partitioning);
+
+/**
+ * Partitioned packed CSR with edge values of type value_t, value_t = void stores an unweighted graph
+ */
+template <typename value_t>
 class PPPCSR {
  public:
-  // data members
-  edge_list_t edges;
+  typedef typename PCSR<value_t>::value_type value_type;
+  typedef typename PCSR<value_t>::batch_edge_t batch_edge_t;
+
+  /// partition hint of an operation whose caller hasn't looked up the partition of the source
+  static constexpr std::size_t NO_PARTITION = std::numeric_limits<std::size_t>::max();
 
-  PPPCSR(uint32_t init_n, uint32_t, bool lock_search, int numDomain, int partitionsPerDomain, bool use_numa);
+  /**
+   * Creates init_n nodes without edges. Partitioning::DEGREE has no degrees to go by and splits like RANGE.
+   */
+  PPPCSR(vertex_t init_n, vertex_t, bool lock_search, int numDomain, int partitionsPerDomain, bool use_numa,
+         MemoryBackend memory_backend = MemoryBackend::MALLOC, Partitioning partitioning = Partitioning::RANGE);
+  /**
+   * Builds the partitions from an edge list, see the bulk-loading constructor of PCSR
+   * @param edge_list edges in any order, edges with a source >= init_n are skipped
+   */
+  PPPCSR(vertex_t init_n, std::vector<batch_edge_t> edge_list, bool lock_search, int numDomain,
+         int partitionsPerDomain, bool use_numa, MemoryBackend memory_backend = MemoryBackend::MALLOC,
+         Partitioning partitioning = Partitioning::RANGE);
   //    PPPCSR(uint32_t init_n, vector<condition_variable*> *cvs, bool search_lock);
-  //    ~PPPCSR();
+  ~PPPCSR();
   /** Public API */
-  bool edge_exists(uint32_t src, uint32_t dest);
-  void add_node();
-  void add_edge(uint32_t src, uint32_t dest, uint32_t value);
-  void remove_edge(uint32_t src, uint32_t dest);
-  void read_neighbourhood(int src);
+  bool edge_exists(vertex_t src, vertex_t dest);
+  /**
+   * Adds a node, reusing the id of a removed node if there is one
+   * @return id of the node
+   */
+  vertex_t add_node();
+  /**
+   * The update and read operations take the partition of src as an optional hint, e.g. the result of an earlier
+   * get_partiton call. A hint that is stale because a boundary moved in between only costs one more lookup.
+   */
+  void add_edge(vertex_t src, vertex_t dest, value_type value = value_type(),
+                std::size_t partition_hint = NO_PARTITION);
+  void remove_edge(vertex_t src, vertex_t dest, std::size_t partition_hint = NO_PARTITION);
+  void read_neighbourhood(vertex_t src, std::size_t partition_hint = NO_PARTITION);
+
+  /**
+   * Inserts a batch of edges, see PCSR::add_edges_batch. The batch is split by partition and the pieces are merged
+   * in parallel, each on a thread of the partition's NUMA domain.
+   * @param batch edges in any order
+   */
+  void add_edges_batch(std::vector<batch_edge_t> batch);
+
+  /**
+   * Removes a batch of edges, see PCSR::remove_edges_batch. The pieces of the partitions are removed in parallel.
+   * @param batch {src, dest} pairs in any order
+   */
+  void remove_edges_batch(std::vector<std::pair<vertex_t, vertex_t>> batch);
+
+  /**
+   * Removes all edges of src, see PCSR::clear_neighbourhood
+   */
+  void clear_neighbourhood(vertex_t src);
 
+  /**
+   * Removes src and the edges pointing to it from all partitions in parallel, see PCSR::remove_node
+   */
+  void remove_node(vertex_t src);
+
+  /**
+   * Returns the partition that owns vertex_id. As long as the boundaries are where the constructor put them this is a
+   * division, afterwards a branch-free binary search over the boundaries. Partitioning::HASH always takes a modulo.
+   */
   std::size_t get_partiton(size_t vertex_id) const;
 
-  vector<int> get_neighbourhood(int src) const;
+  vector<vertex_t> get_neighbourhood(vertex_t src) const;
+
+  /**
+   * Calls f(dest, value) for every edge of src in place, see PCSR::for_each_neighbour. The partition of src is looked
+   * up once and the neighbourhood can't move to another partition while f runs, so f must not modify the graph.
+   */
+  template <typename F>
+  void for_each_neighbour(vertex_t src, F f) const {
+    route(src, NO_PARTITION, [&](std::size_t p, vertex_t local) { partitions[p].for_each_neighbour(local, f); });
+  }
+
+  /**
+   * Runs one round of load balancing: samples the edge count and the update rate of every partition and, if the
+   * busiest partition carries more than (1 + tolerance) times its fair share, shifts the boundaries between
+   * neighbouring partitions towards an even split. Every boundary moves by at most half of the partition it takes
+   * vertices from, and only the two partitions next to it pause while it moves.
+   * Hash partitions have no boundaries, they are never rebalanced.
+   * @return true if a boundary moved
+   */
+  bool rebalance(double tolerance = 0.25);
+
+  /**
+   * Starts a background thread that calls rebalance every interval while updates keep flowing
+   */
+  void start_rebalancer(std::chrono::milliseconds interval, double tolerance = 0.25);
+
+  /**
+   * Stops the background rebalancer, if it is running
+   */
+  void stop_rebalancer();
 
   /**
    * Returns the node count
@@ -34,29 +144,133 @@ class PPPCSR {
   uint64_t get_n();
 
   /**
-   * Returns a ref. to the node with the given id
+   * Returns a ref. to the node with the given id, the ref. is invalidated when the rebalancer moves the node
    * @return ref. to node
    */
-  node_t &getNode(int id);
+  node_t &getNode(vertex_t id);
 
   /**
-   * Returns a const ref. to the node with the given id
+   * Returns a const ref. to the node with the given id, the ref. is invalidated when the rebalancer moves the node
    * @return const ref. to node
    */
-  const node_t &getNode(int id) const;
+  const node_t &getNode(vertex_t id) const;
 
-  void registerThread(int par) { partitions[par].edges.global_lock->registerThread(); }
+ private:
+  /// unregisters the calling thread from a partition's global lock when it goes out of scope
+  class Registration {
+   public:
+    explicit Registration(FastLock &lock) : lock(lock) {}
+    ~Registration() { lock.unregisterThread(); }
 
-  void unregisterThread(int par) { partitions[par].edges.global_lock->unregisterThread(); }
+   private:
+    FastLock &lock;
+  };
+
+  /**
+   * Splits init_n vertices into partitionsPerDomain partitions per domain, fills distribution and returns the number
+   * of vertices of every partition
+   * @param core_graph edges whose sources weigh in for Partitioning::DEGREE
+   */
+  std::vector<vertex_t> split_vertices(vertex_t init_n, std::size_t numDomains,
+                                       const std::vector<batch_edge_t> &core_graph);
+
+  /**
+   * Returns true if partition p owns src at the moment
+   */
+  bool owns(std::size_t p, vertex_t src) const;
+
+  /**
+   * Converts between the global id of a vertex and its id in partition p
+   */
+  vertex_t to_local(std::size_t p, vertex_t id) const;
+  vertex_t to_global(std::size_t p, vertex_t local) const;
+
+  /**
+   * Runs fn(p, local id of src) for the partition p that owns src, trying partition_hint first. The calling thread is
+   * registered with the partition's global lock while fn runs and the boundaries of p can't move until fn returns.
+   */
+  template <typename F>
+  auto route(vertex_t src, std::size_t partition_hint, F fn) const -> decltype(fn(std::size_t(), vertex_t()));
+
+  /**
+   * Runs fn(p) for every partition p that is selected by the predicate, in parallel, each on a thread of the
+   * partition's NUMA domain that is registered with the partition's global lock
+   */
+  template <typename P, typename F>
+  void for_each_partition(P selected, F fn);
+
+  /**
+   * Splits a batch by the partition of the source, whose id is made local to the partition, and runs
+   * apply(partition, piece) for every non-empty piece in parallel, each on a thread of the partition's NUMA domain
+   */
+  template <typename T, typename F>
+  void apply_partitioned(std::vector<T> batch, vertex_t T::*src, F apply);
+
+  /**
+   * Moves count vertices with their edges across the boundary between partitions left and left + 1: from the end of
+   * left if to_right, from the front of left + 1 otherwise. Waits until no thread works on either partition.
+   */
+  void move_boundary(std::size_t left, vertex_t count, bool to_right);
+
+  /**
+   * Moves the calling thread to the NUMA domain of partition p, anywhere if the partitions aren't bound to domains
+   */
+  void run_on_domain_of(std::size_t p) const;
 
- private:
   /// different partitions
-  std::vector<PCSR> partitions;
+  std::vector<PCSR<value_t>> partitions;
+
+  /// start index vertices in the partitions, moved by the rebalancer, all 0 for Partitioning::HASH
+  std::vector<std::atomic<size_t>> distribution;
+
+  /// vertices per partition while all boundaries are evenly spaced (the last partition takes the rest), 0 once the
+  /// rebalancer moved a boundary
+  std::atomic<size_t> uniform_partition_size{0};
 
-  /// start index vertices in the partitions
-  std::vector<size_t> distribution;
+  /// per-partition state of the rebalancer, padded to a cache line so partitions don't share lines
+  struct partition_state {
+    std::atomic<bool> migrating{false};  // set while a boundary of the partition moves
+    std::atomic<uint64_t> updates{0};    // updates routed to the partition since the last rebalancing round
+    char padding[48];
+  };
+  std::unique_ptr<partition_state[]> states;
+
+  /// held by every boundary move and by the operations that span partitions or change their sizes
+  std::mutex migration_mutex;
+
+  std::thread rebalancer;
+  std::atomic_bool stop_rebalancing{false};
 
   int partitionsPerDomain;
+
+  /// true if the partitions are bound to NUMA domains
+  bool use_numa;
+
+  Partitioning partitioning;
 };
 
+template <typename value_t>
+template <typename F>
+auto PPPCSR<value_t>::route(vertex_t src, std::size_t partition_hint, F fn) const
+    -> decltype(fn(std::size_t(), vertex_t())) {
+  // the hint only saves the lookup, it is checked like any other route
+  std::size_t p = (partition_hint < partitions.size()) ? partition_hint : get_partiton(src);
+  for (;;) {
+    FastLock &lock = *partitions[p].edges.global_lock;
+    // A boundary move waits until no thread is registered with the partition, so once registered the route can only
+    // change if the move had already started. Then the flag is set and the thread backs off until the move is done.
+    // Callers that are registered already keep their slot, their registration holds off moves of the partition anyway.
+    lock.registerThread();
+    if (!states[p].migrating.load() && owns(p, src)) {
+      const Registration registration(lock);
+      return fn(p, to_local(p, src));
+    }
+    lock.unregisterThread();
+    while (states[p].migrating.load()) {
+      std::this_thread::yield();
+    }
+    p = get_partiton(src);
+  }
+}
+
 #endif  // PPPCSR_H
@@ -0,0 +1,119 @@
+/**
+ * @file edgeList.cpp
+ */
+
+#include "edgeList.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+// bytes read at once from files that can't be mapped
+constexpr std::size_t READ_CHUNK_SIZE = std::size_t(1) << 20;
+
+// parses [begin, end) with the given number of threads, every thread takes the lines starting in its share of the bytes
+update_list parse_edge_list(const char *begin, const char *end, Operation default_op, unsigned threads) {
+  // the last line may lack its line break, it is parsed from a copy so that the scanner finds one
+  const char *last_line = end;
+  while (last_line != begin && last_line[-1] != '\n') {
+    last_line--;
+  }
+  const std::size_t bytes = last_line - begin;
+  threads = static_cast<unsigned>(std::max<std::size_t>(1, std::min<std::size_t>(threads, bytes / 4096)));
+
+  std::vector<const char *> bounds(threads + 1, last_line);
+  bounds[0] = begin;
+  for (unsigned t = 1; t < threads; t++) {
+    const char *p = std::max(begin + bytes / threads * t, bounds[t - 1]);
+    while (p != last_line && p[-1] != '\n') {
+      p++;
+    }
+    bounds[t] = p;
+  }
+
+  update_list edges;
+  edges.parts.resize(threads);
+  std::vector<vertex_t> max_ids(threads, 0);
+  std::vector<std::size_t> invalid(threads, 0);
+  std::vector<std::string> first_invalid(threads);
+  auto parse = [&](unsigned t, const char *from, const char *to) {
+    parse_updates(
+        from, to, default_op,
+        [&](const update &u) {
+          edges.parts[t].push_back(u);
+          max_ids[t] = std::max(max_ids[t], std::max(u.src, u.dest));
+        },
+        [&](const std::string &line) {
+          if (invalid[t]++ == 0) {
+            first_invalid[t] = line;
+          }
+        });
+  };
+
+  std::vector<std::thread> parsers;
+  for (unsigned t = 1; t < threads; t++) {
+    parsers.emplace_back(parse, t, bounds[t], bounds[t + 1]);
+  }
+  parse(0, bounds[0], bounds[1]);
+  for (auto &parser : parsers) {
+    parser.join();
+  }
+  if (last_line != end) {
+    const std::string tail = std::string(last_line, end) + '\n';
+    parse(threads - 1, tail.data(), tail.data() + tail.size());
+  }
+
+  for (unsigned t = 0; t < threads; t++) {
+    edges.max_id = std::max(edges.max_id, max_ids[t]);
+    if (invalid[t] != 0 && edges.invalid == 0) {
+      std::cerr << "Skipping invalid line: " << first_invalid[t] << std::endl;
+    }
+    edges.invalid += invalid[t];
+  }
+  return edges;
+}
+
+}  // namespace
+
+update_list read_edge_list(const std::string &path, Operation default_op, unsigned threads) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) != 0) {
+    std::cerr << "Invalid file" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (!S_ISREG(info.st_mode) || info.st_size == 0) {
+    close(fd);
+    std::string content;
+    ChunkReader reader(path, READ_CHUNK_SIZE);
+    std::string chunk;
+    while (reader.next(chunk)) {
+      content += chunk;
+    }
+    return parse_edge_list(content.data(), content.data() + content.size(), default_op, threads);
+  }
+
+  const std::size_t size = info.st_size;
+  void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    std::cerr << "Mapping " << path << " failed: " << strerror(errno) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  // every thread reads its piece front to back
+  madvise(mapping, size, MADV_SEQUENTIAL);
+  const char *begin = static_cast<const char *>(mapping);
+  update_list edges = parse_edge_list(begin, begin + size, default_op, threads);
+  munmap(mapping, size);
+  return edges;
+}
@@ -0,0 +1,55 @@
+/**
+ * @file edgeList.h
+ * Parallel loader of edge list files
+ */
+
+#ifndef PARALLEL_PACKED_CSR_EDGELIST_H
+#define PARALLEL_PACKED_CSR_EDGELIST_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "updateStream.h"
+
+/**
+ * Edges of an edge list file in file order: every thread that parsed the file produced one part, the parts follow each
+ * other in the file.
+ */
+struct update_list {
+  std::vector<std::vector<update>> parts;
+  vertex_t max_id = 0;       // largest vertex id of all edges
+  std::size_t invalid = 0;   // lines that were skipped
+
+  std::size_t size() const {
+    std::size_t n = 0;
+    for (const auto &part : parts) {
+      n += part.size();
+    }
+    return n;
+  }
+
+  bool empty() const { return size() == 0; }
+
+  // calls f(update) for the first limit edges in file order
+  template <typename F>
+  void for_each(F f, std::size_t limit = static_cast<std::size_t>(-1)) const {
+    for (const auto &part : parts) {
+      for (const update &u : part) {
+        if (limit-- == 0) {
+          return;
+        }
+        f(u);
+      }
+    }
+  }
+};
+
+/**
+ * Reads the lines "src dest [op]" of a file (see parse_updates) with the given number of threads. A regular file is
+ * mapped into memory and split into one piece per thread at line breaks, anything else (e.g. a named pipe) is read
+ * first and then split.
+ */
+update_list read_edge_list(const std::string &path, Operation default_op, unsigned threads);
+
+#endif  // PARALLEL_PACKED_CSR_EDGELIST_H
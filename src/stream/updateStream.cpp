@@ -0,0 +1,62 @@
+/**
+ * @file updateStream.cpp
+ */
+
+#include "updateStream.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+ChunkReader::ChunkReader(const std::string &path, std::size_t chunk_size) : chunk_size(chunk_size) {
+  fd = (path == "-") ? STDIN_FILENO : open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cout << "Couldn't open " << path << ": " << strerror(errno) << ". Abort\n";
+    exit(EXIT_FAILURE);
+  }
+}
+
+ChunkReader::~ChunkReader() {
+  if (fd != STDIN_FILENO) {
+    close(fd);
+  }
+}
+
+bool ChunkReader::next(std::string &chunk) {
+  chunk.swap(carry);
+  carry.clear();
+  for (;;) {
+    const std::size_t filled = chunk.size();
+    chunk.resize(filled + chunk_size);
+    const ssize_t bytes = read(fd, &chunk[filled], chunk_size);
+    if (bytes < 0) {
+      chunk.resize(filled);
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cout << "Reading the update stream failed: " << strerror(errno) << ". Abort\n";
+      exit(EXIT_FAILURE);
+    }
+    chunk.resize(filled + bytes);
+    if (bytes == 0) {
+      // end of the stream, the last line may lack its line break
+      if (chunk.empty()) {
+        return false;
+      }
+      if (chunk.back() != '\n') {
+        chunk.push_back('\n');
+      }
+      return true;
+    }
+    const std::size_t last = chunk.rfind('\n');
+    if (last != std::string::npos) {
+      carry.assign(chunk, last + 1, std::string::npos);
+      chunk.resize(last + 1);
+      return true;
+    }
+  }
+}
@@ -0,0 +1,105 @@
+/**
+ * @file updateStream.h
+ * Reading and parsing a stream of edge updates in chunks, for files, named pipes and stdin alike
+ */
+
+#ifndef PARALLEL_PACKED_CSR_UPDATESTREAM_H
+#define PARALLEL_PACKED_CSR_UPDATESTREAM_H
+
+#include <types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+
+enum class Operation { READ, ADD, DELETE };
+
+struct update {
+  Operation op;
+  vertex_t src;
+  vertex_t dest;
+};
+
+/**
+ * Reads a file, a named pipe or stdin ("-") in chunks that end with a complete line. A chunk is returned as soon as a
+ * read brings in a line break, so a slow stream is passed on line by line instead of waiting for a full chunk.
+ */
+class ChunkReader {
+ public:
+  ChunkReader(const std::string &path, std::size_t chunk_size);
+  ~ChunkReader();
+
+  ChunkReader(const ChunkReader &) = delete;
+  ChunkReader &operator=(const ChunkReader &) = delete;
+
+  /**
+   * Replaces chunk with the next lines of the stream, at most about chunk_size bytes unless a single line is longer
+   * @return false at the end of the stream
+   */
+  bool next(std::string &chunk);
+
+ private:
+  int fd;
+  std::size_t chunk_size;
+  // start of a line that the previous chunk cut off
+  std::string carry;
+};
+
+/**
+ * Parses the lines "src dest [op]" of [begin, end), which has to end with a line break. Op 1 adds the edge, 0 deletes
+ * it and without op the update gets default_op. Fields are separated by a single character.
+ * Calls f(update) for every valid line and invalid(line) for every other non-empty line. The ids aren't checked against
+ * the graph, only against the range of vertex_t.
+ */
+template <typename F, typename G>
+void parse_updates(const char *begin, const char *end, Operation default_op, F f, G invalid) {
+  const char *line = begin;
+  while (line < end) {
+    const char *p = line;
+    uint64_t ids[2] = {0, 0};
+    bool valid = true;
+    for (int field = 0; field < 2 && valid; field++) {
+      if (field == 1) {
+        // single separator
+        valid = (*p != '\n');
+        p += valid;
+      }
+      while (*p == ' ' || *p == '\t') {
+        p++;
+      }
+      const char *digits = p;
+      // at most 19 digits fit into 64 bits, longer ids don't fit into a vertex id anyway
+      while (*p >= '0' && *p <= '9' && p - digits < 20) {
+        ids[field] = ids[field] * 10 + (*p - '0');
+        p++;
+      }
+      valid &= (p != digits && p - digits < 20 && ids[field] <= std::numeric_limits<vertex_t>::max());
+    }
+    Operation op = default_op;
+    if (valid && *p != '\n' && *p != '\r') {
+      switch (p[1]) {
+        case '1':
+          op = Operation::ADD;
+          break;
+        case '0':
+          op = Operation::DELETE;
+          break;
+        default:
+          valid = false;
+      }
+    }
+    const char *next = p;
+    while (*next != '\n') {
+      next++;
+    }
+    if (valid) {
+      f(update{op, static_cast<vertex_t>(ids[0]), static_cast<vertex_t>(ids[1])});
+    } else if (next != line && !(next == line + 1 && *line == '\r')) {
+      invalid(std::string(line, next));
+    }
+    line = next + 1;
+  }
+}
+
+#endif  // PARALLEL_PACKED_CSR_UPDATESTREAM_H
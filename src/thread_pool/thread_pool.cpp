@@ -8,79 +8,93 @@
 #include <ctime>
 #include <iostream>
 #include <mutex>
-#include <queue>
 #include <thread>
 #include <vector>
 using namespace std;
 
 /**
- * Initializes a pool of threads. Every thread has its own task queue.
+ * Initializes a pool of threads. Every thread has its own bounded task queue.
  */
-ThreadPool::ThreadPool(const int NUM_OF_THREADS, bool lock_search, uint32_t init_num_nodes, int partitions_per_domain)
-    : finished(false) {
-  tasks.resize(NUM_OF_THREADS);
-  pcsr = new PCSR(init_num_nodes, init_num_nodes, lock_search, -1);
+ThreadPool::ThreadPool(const int NUM_OF_THREADS, bool lock_search, vertex_t init_num_nodes, int partitions_per_domain,
+                       MemoryBackend memory_backend)
+    : progress(NUM_OF_THREADS), finished(false) {
+  for (int i = 0; i < NUM_OF_THREADS; i++) {
+    tasks.emplace_back(new MPSCQueue<task>(TASK_QUEUE_CAPACITY));
+  }
+  pcsr = new PCSR<void>(init_num_nodes, init_num_nodes, lock_search, -1, memory_backend);
+}
+
+ThreadPool::ThreadPool(const int NUM_OF_THREADS, bool lock_search, vertex_t init_num_nodes,
+                       std::vector<PCSR<void>::batch_edge_t> core_graph, MemoryBackend memory_backend)
+    : progress(NUM_OF_THREADS), finished(false) {
+  for (int i = 0; i < NUM_OF_THREADS; i++) {
+    tasks.emplace_back(new MPSCQueue<task>(TASK_QUEUE_CAPACITY));
+  }
+  pcsr = new PCSR<void>(init_num_nodes, std::move(core_graph), lock_search, -1, memory_backend);
 }
 
 // Function executed by worker threads
 // Does insertions, deletions and reads on the PCSR
-// Finishes when finished is set to true and there are no outstanding tasks
-template <bool isMasterThread>
+// Sleeps while its queue is empty, finishes when finished is set to true and there are no outstanding tasks
 void ThreadPool::execute(int thread_id) {
-  cout << "Thread " << thread_id << " has " << tasks[thread_id].size() << " tasks" << endl;
+  MPSCQueue<task> &queue = *tasks[thread_id];
+  uint64_t executed = 0;
+  bool registered = false;
 
-  int registered = -1;
-
-  while (!tasks[thread_id].empty() || (!isMasterThread && !finished)) {
-    if (!tasks[thread_id].empty()) {
-      task t = tasks[thread_id].front();
-      tasks[thread_id].pop();
-
-      if (registered == -1) {
+  task t;
+  for (;;) {
+    if (queue.try_pop(t)) {
+      if (!registered) {
         pcsr->edges.global_lock->registerThread();
-        registered = 0;
+        registered = true;
       }
       if (t.add) {
-        pcsr->add_edge(t.src, t.target, 1);
+        pcsr->add_edge(t.src, t.target);
       } else if (!t.read) {
         pcsr->remove_edge(t.src, t.target);
       } else {
         pcsr->read_neighbourhood(t.src);
       }
-
-    } else {
-      if (registered != -1) {
-        pcsr->edges.global_lock->unregisterThread();
-        registered = -1;
-      }
+      progress[thread_id].executed.store(++executed, std::memory_order_relaxed);
+      continue;
     }
+    // an idle thread must not hold up writers waiting for the registered threads
+    if (registered) {
+      pcsr->edges.global_lock->unregisterThread();
+      registered = false;
+    }
+    if (finished && queue.empty()) {
+      break;
+    }
+    queue.wait([this] { return finished.load(); });
   }
-  if (registered != -1) {
-    pcsr->edges.global_lock->unregisterThread();
-  }
+  cout << "Thread " << thread_id << " executed " << executed << " tasks" << endl;
 }
 
 // Submit an update for edge {src, target} to thread with number thread_id
-void ThreadPool::submit_add(int thread_id, int src, int target) {
-  tasks[thread_id].push(task{true, false, src, target});
+void ThreadPool::submit_add(int thread_id, vertex_t src, vertex_t target) {
+  tasks[thread_id]->push(task{true, false, 0, src, target});
 }
 
 // Submit a delete edge task for edge {src, target} to thread with number thread_id
-void ThreadPool::submit_delete(int thread_id, int src, int target) {
-  tasks[thread_id].push(task{false, false, src, target});
+void ThreadPool::submit_delete(int thread_id, vertex_t src, vertex_t target) {
+  tasks[thread_id]->push(task{false, false, 0, src, target});
 }
 
 // Submit a read neighbourhood task for vertex src to thread with number thread_id
-void ThreadPool::submit_read(int thread_id, int src) { tasks[thread_id].push(task{false, true, src, src}); }
+void ThreadPool::submit_read(int thread_id, vertex_t src) { tasks[thread_id]->push(task{false, true, 0, src, src}); }
 
 // starts a new number of threads
 // number of threads is passed to the constructor
 void ThreadPool::start(int threads) {
   s = chrono::steady_clock::now();
   finished = false;
+  for (auto &p : progress) {
+    p.executed.store(0);
+  }
 
-  for (int i = 1; i < threads; i++) {
-    thread_pool.push_back(thread(&ThreadPool::execute<false>, this, i));
+  for (int i = 0; i < threads; i++) {
+    thread_pool.push_back(thread(&ThreadPool::execute, this, i));
     // Pin thread to core
     //    cpu_set_t cpuset;
     //    CPU_ZERO(&cpuset);
@@ -96,13 +110,23 @@ void ThreadPool::start(int threads) {
     //      cout << "error pinning thread" << endl;
     //    }
   }
-  execute<true>(0);
+}
+
+uint64_t ThreadPool::executed_tasks() const {
+  uint64_t executed = 0;
+  for (const auto &p : progress) {
+    executed += p.executed.load(std::memory_order_relaxed);
+  }
+  return executed;
 }
 
 // Stops currently running worker threads without redistributing worker threads
 // start() can still be used after this is called to start a new set of threads operating on the same pcsr
 void ThreadPool::stop() {
   finished = true;
+  for (auto &queue : tasks) {
+    queue->notify();
+  }
   for (auto &&t : thread_pool) {
     if (t.joinable()) t.join();
     cout << "Done" << endl;
@@ -3,11 +3,12 @@
  * modified by Christian Menges
  */
 
-#include <queue>
+#include <memory>
 #include <thread>
 #include <vector>
 
 #include "../pcsr/PCSR.h"
+#include "mpscQueue.h"
 #include "task.h"
 
 using namespace std;
@@ -16,26 +17,31 @@ using namespace std;
 
 class ThreadPool {
  public:
-  PCSR *pcsr;
+  PCSR<void> *pcsr;
 
-  explicit ThreadPool(const int NUM_OF_THREADS, bool lock_search, uint32_t init_num_nodes, int partitions_per_domain);
+  explicit ThreadPool(const int NUM_OF_THREADS, bool lock_search, vertex_t init_num_nodes, int partitions_per_domain,
+                      MemoryBackend memory_backend = MemoryBackend::MALLOC);
+  // bulk-loads the PCSR with the given core graph
+  ThreadPool(const int NUM_OF_THREADS, bool lock_search, vertex_t init_num_nodes,
+             std::vector<PCSR<void>::batch_edge_t> core_graph, MemoryBackend memory_backend = MemoryBackend::MALLOC);
   ~ThreadPool() = default;
 
-  /** Public API */
-  void submit_add(int thread_id, int src, int dest);     // submit task to thread {thread_id} to insert edge {src, dest}
-  void submit_delete(int thread_id, int src, int dest);  // submit task to thread {thread_id} to delete edge {src, dest}
-  void submit_read(int, int);  // submit task to thread {thread_id} to read the neighbourhood of vertex {src}
-  void start(int threads);     // start the threads
-  void stop();                 // stop the threads
+  /** Public API, any number of threads may submit while the threads run. Submitting blocks while the queue is full. */
+  void submit_add(int thread_id, vertex_t src, vertex_t dest);    // submit task to thread {thread_id} to insert edge {src, dest}
+  void submit_delete(int thread_id, vertex_t src, vertex_t dest);  // submit task to thread {thread_id} to delete edge {src, dest}
+  void submit_read(int, vertex_t);  // submit task to thread {thread_id} to read the neighbourhood of vertex {src}
+  void start(int threads);     // start the threads, they sleep while their queues are empty
+  void stop();                 // stop the threads once they executed all submitted tasks
+  uint64_t executed_tasks() const;  // tasks executed since start(), may be called while the threads run
 
  private:
   vector<thread> thread_pool;
-  vector<queue<task>> tasks;
+  vector<unique_ptr<MPSCQueue<task>>> tasks;
+  vector<task_progress> progress;
   chrono::steady_clock::time_point s;
   chrono::steady_clock::time_point end;
   std::atomic_bool finished;
 
-  template <bool isMasterThread>
   void execute(int);
 };
 
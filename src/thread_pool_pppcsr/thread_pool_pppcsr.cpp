@@ -15,20 +15,53 @@
 using namespace std;
 
 /**
- * Initializes a pool of threads. Every thread has its own task queue.
+ * Initializes a pool of threads. Every thread has its own bounded task queue and steals from the others when it runs
+ * dry.
  */
-ThreadPoolPPPCSR::ThreadPoolPPPCSR(const int NUM_OF_THREADS, bool lock_search, uint32_t init_num_nodes,
-                                   int partitions_per_domain, bool use_numa)
+ThreadPoolPPPCSR::ThreadPoolPPPCSR(const int NUM_OF_THREADS, bool lock_search, vertex_t init_num_nodes,
+                                   int partitions_per_domain, bool use_numa, MemoryBackend memory_backend,
+                                   Partitioning partitioning)
     : tasks(NUM_OF_THREADS),
+      stats(NUM_OF_THREADS),
+      progress(NUM_OF_THREADS),
       finished(false),
       available_nodes(std::min(numa_max_node() + 1, NUM_OF_THREADS)),
-      indeces(available_nodes, 0),
+      indeces(available_nodes),
       partitions_per_domain(partitions_per_domain),
       threadToDomain(NUM_OF_THREADS),
       firstThreadDomain(available_nodes, 0),
       numThreadsDomain(available_nodes) {
-  pcsr = new PPPCSR(init_num_nodes, init_num_nodes, lock_search, available_nodes, partitions_per_domain, use_numa);
+  pcsr = new PPPCSR<void>(init_num_nodes, init_num_nodes, lock_search, available_nodes, partitions_per_domain, use_numa,
+                          memory_backend, partitioning);
+  assign_domains(NUM_OF_THREADS);
+}
 
+ThreadPoolPPPCSR::ThreadPoolPPPCSR(const int NUM_OF_THREADS, bool lock_search, vertex_t init_num_nodes,
+                                   std::vector<PPPCSR<void>::batch_edge_t> core_graph, int partitions_per_domain,
+                                   bool use_numa, MemoryBackend memory_backend, Partitioning partitioning)
+    : tasks(NUM_OF_THREADS),
+      stats(NUM_OF_THREADS),
+      progress(NUM_OF_THREADS),
+      finished(false),
+      available_nodes(std::min(numa_max_node() + 1, NUM_OF_THREADS)),
+      indeces(available_nodes),
+      partitions_per_domain(partitions_per_domain),
+      threadToDomain(NUM_OF_THREADS),
+      firstThreadDomain(available_nodes, 0),
+      numThreadsDomain(available_nodes) {
+  pcsr = new PPPCSR<void>(init_num_nodes, std::move(core_graph), lock_search, available_nodes, partitions_per_domain,
+                          use_numa, memory_backend, partitioning);
+  assign_domains(NUM_OF_THREADS);
+}
+
+// Spreads the threads evenly across the domains, consecutive threads share a domain
+void ThreadPoolPPPCSR::assign_domains(const int NUM_OF_THREADS) {
+  for (int i = 0; i < NUM_OF_THREADS; i++) {
+    inboxes.emplace_back(new MPSCQueue<task>(TASK_QUEUE_CAPACITY));
+  }
+  for (auto &index : indeces) {
+    index = 0;
+  }
   int d = available_nodes;
   int minNumThreads = NUM_OF_THREADS / d;
   int threshold = NUM_OF_THREADS % d;
@@ -49,71 +82,134 @@ ThreadPoolPPPCSR::ThreadPoolPPPCSR(const int NUM_OF_THREADS, bool lock_search, u
 
 // Function executed by worker threads
 // Does insertions, deletions and reads on the PCSR
-// Finishes when finished is set to true and there are no outstanding tasks
-template <bool isMasterThread>
+// Sleeps while there is nothing to execute or steal, finishes when finished is set to true and there are no
+// outstanding tasks in its queue
 void ThreadPoolPPPCSR::execute(const int thread_id) {
-  cout << "Thread " << thread_id << " has " << tasks[thread_id].size() << " tasks, runs on domain "
-       << threadToDomain[thread_id] << endl;
+  cout << "Thread " << thread_id << " runs on domain " << threadToDomain[thread_id] << endl;
   if (numa_available() >= 0) {
     numa_run_on_node(threadToDomain[thread_id]);
   }
-  int registered = -1;
-
-  while (!tasks[thread_id].empty() || (!isMasterThread && !finished)) {
-    if (!tasks[thread_id].empty()) {
-      task t = tasks[thread_id].front();
-      tasks[thread_id].pop();
 
-      int currentPar = pcsr->get_partiton(t.src);
-
-      if (registered != currentPar) {
-        if (registered != -1) {
-          pcsr->unregisterThread(registered);
-        }
-        pcsr->registerThread(currentPar);
-        registered = currentPar;
-      }
-      if (t.add) {
-        pcsr->add_edge(t.src, t.target, 1);
-      } else if (!t.read) {
-        pcsr->remove_edge(t.src, t.target);
-      } else {
-        pcsr->read_neighbourhood(t.src);
+  MPSCQueue<task> &inbox = *inboxes[thread_id];
+  // counted locally, the counters of neighbouring threads share cache lines
+  worker_stats local;
+  task t;
+  for (;;) {
+    if (!tasks[thread_id].pop(t) && !refill(thread_id, t) && !steal(thread_id, t, local)) {
+      if (finished && inbox.empty()) {
+        break;
       }
+      sleeping_threads.fetch_add(1);
+      inbox.wait([this] { return finished.load(); });
+      sleeping_threads.fetch_sub(1);
+      continue;
+    }
+    progress[thread_id].executed.store(++local.executed, std::memory_order_relaxed);
+    // the data structure registers the thread with the partition of the task itself, the partition looked up at
+    // submission saves it the lookup unless the rebalancer moved src in between
+    if (t.add) {
+      pcsr->add_edge(t.src, t.target, {}, t.partition);
+    } else if (!t.read) {
+      pcsr->remove_edge(t.src, t.target, t.partition);
     } else {
-      if (registered != -1) {
-        pcsr->unregisterThread(registered);
-        registered = -1;
-      }
+      pcsr->read_neighbourhood(t.src, t.partition);
     }
   }
-  if (registered != -1) {
-    pcsr->unregisterThread(registered);
+  stats[thread_id] = local;
+}
+
+bool ThreadPoolPPPCSR::refill(const int thread_id, task &t) {
+  // enough to keep the thieves busy without draining the inbox, which would defeat its backpressure
+  const int batch = 64;
+  MPSCQueue<task> &inbox = *inboxes[thread_id];
+  if (!inbox.try_pop(t)) {
+    return false;
+  }
+  task next;
+  int moved = 0;
+  while (moved < batch && inbox.try_pop(next)) {
+    tasks[thread_id].push(next);
+    moved++;
+  }
+  if (moved > 0) {
+    wake_thief(thread_id);
   }
+  return true;
+}
+
+void ThreadPoolPPPCSR::wake_thief(const int thread_id) {
+  if (sleeping_threads.load() == 0) {
+    return;
+  }
+  const int domain = threadToDomain[thread_id];
+  for (int d = 0; d < available_nodes; d++) {
+    const int thief_domain = (domain + d) % available_nodes;
+    for (int i = 0; i < numThreadsDomain[thief_domain]; i++) {
+      const int thief = firstThreadDomain[thief_domain] + i;
+      if (thief < running_threads && inboxes[thief]->consumer_waiting()) {
+        inboxes[thief]->notify();
+        return;
+      }
+    }
+  }
+}
+
+bool ThreadPoolPPPCSR::steal(const int thread_id, task &t, worker_stats &local) {
+  const int domain = threadToDomain[thread_id];
+  bool lost_race;
+  do {
+    lost_race = false;
+    // own domain first, starting with the next thread, then the other domains in order
+    for (int d = 0; d < available_nodes; d++) {
+      const int victim_domain = (domain + d) % available_nodes;
+      const int first = firstThreadDomain[victim_domain];
+      const int count = numThreadsDomain[victim_domain];
+      for (int i = 0; i < count; i++) {
+        const int victim = first + (thread_id + 1 + i) % count;
+        if (victim == thread_id) {
+          continue;
+        }
+        const auto result = tasks[victim].steal(t);
+        if (result == WorkStealingDeque<task>::Steal::SUCCESS) {
+          if (d == 0) {
+            local.domain_steals++;
+          } else {
+            local.remote_steals++;
+          }
+          return true;
+        }
+        lost_race |= (result == WorkStealingDeque<task>::Steal::LOST_RACE);
+      }
+    }
+  } while (lost_race);
+  return false;
 }
 
 // Submit an update for edge {src, target} to thread with number thread_id
-void ThreadPoolPPPCSR::submit_add(int thread_id, int src, int target) {
+void ThreadPoolPPPCSR::submit_add(int thread_id, vertex_t src, vertex_t target) {
   (void)thread_id;
-  auto par = pcsr->get_partiton(src) / partitions_per_domain;
+  const auto partition = pcsr->get_partiton(src);
+  auto par = partition / partitions_per_domain;
   auto index = (indeces[par]++) % numThreadsDomain[par];
-  tasks[firstThreadDomain[par] + index].push(task{true, false, src, target});
+  inboxes[firstThreadDomain[par] + index]->push(task{true, false, static_cast<uint32_t>(partition), src, target});
 }
 
 // Submit a delete edge task for edge {src, target} to thread with number thread_id
-void ThreadPoolPPPCSR::submit_delete(int thread_id, int src, int target) {
+void ThreadPoolPPPCSR::submit_delete(int thread_id, vertex_t src, vertex_t target) {
   (void)thread_id;
-  auto par = pcsr->get_partiton(src) / partitions_per_domain;
+  const auto partition = pcsr->get_partiton(src);
+  auto par = partition / partitions_per_domain;
   auto index = (indeces[par]++) % numThreadsDomain[par];
-  tasks[firstThreadDomain[par] + index].push(task{false, false, src, target});
+  inboxes[firstThreadDomain[par] + index]->push(task{false, false, static_cast<uint32_t>(partition), src, target});
 }
 
 // Submit a read neighbourhood task for vertex src to thread with number thread_id
-void ThreadPoolPPPCSR::submit_read(int thread_id, int src) {
+void ThreadPoolPPPCSR::submit_read(int thread_id, vertex_t src) {
   (void)thread_id;
-  auto par = pcsr->get_partiton(src) / partitions_per_domain;
+  const auto partition = pcsr->get_partiton(src);
+  auto par = partition / partitions_per_domain;
   auto index = (indeces[par]++) % numThreadsDomain[par];
-  tasks[firstThreadDomain[par] + index].push(task{false, true, src, src});
+  inboxes[firstThreadDomain[par] + index]->push(task{false, true, static_cast<uint32_t>(partition), src, src});
 }
 
 // starts a new number of threads
@@ -121,9 +217,16 @@ void ThreadPoolPPPCSR::submit_read(int thread_id, int src) {
 void ThreadPoolPPPCSR::start(int threads) {
   s = chrono::steady_clock::now();
   finished = false;
+  running_threads = threads;
+  for (auto &p : progress) {
+    p.executed.store(0);
+  }
+  if (rebalance_interval.count() > 0) {
+    pcsr->start_rebalancer(rebalance_interval);
+  }
 
-  for (int i = 1; i < threads; i++) {
-    thread_pool.push_back(thread(&ThreadPoolPPPCSR::execute<false>, this, i));
+  for (int i = 0; i < threads; i++) {
+    thread_pool.push_back(thread(&ThreadPoolPPPCSR::execute, this, i));
     // Pin thread to core
     //    cpu_set_t cpuset;
     //    CPU_ZERO(&cpuset);
@@ -139,18 +242,38 @@ void ThreadPoolPPPCSR::start(int threads) {
     //      cout << "error pinning thread" << endl;
     //    }
   }
-  execute<true>(0);
+}
+
+uint64_t ThreadPoolPPPCSR::executed_tasks() const {
+  uint64_t executed = 0;
+  for (const auto &p : progress) {
+    executed += p.executed.load(std::memory_order_relaxed);
+  }
+  return executed;
 }
 
 // Stops currently running worker threads without redistributing worker threads
 // start() can still be used after this is called to start a new set of threads operating on the same pcsr
 void ThreadPoolPPPCSR::stop() {
   finished = true;
+  for (auto &inbox : inboxes) {
+    inbox->notify();
+  }
   for (auto &&t : thread_pool) {
     if (t.joinable()) t.join();
     cout << "Done" << endl;
   }
+  pcsr->stop_rebalancer();
   end = chrono::steady_clock::now();
   cout << "Elapsed wall clock time: " << chrono::duration_cast<chrono::milliseconds>(end - s).count() << endl;
+  uint64_t domain_steals = 0;
+  uint64_t remote_steals = 0;
+  for (size_t i = 0; i < thread_pool.size(); i++) {
+    cout << "Thread " << i << " executed " << stats[i].executed << " tasks, stole " << stats[i].domain_steals
+         << " within its domain and " << stats[i].remote_steals << " from other domains" << endl;
+    domain_steals += stats[i].domain_steals;
+    remote_steals += stats[i].remote_steals;
+  }
+  cout << "Steals: " << domain_steals << " within domains, " << remote_steals << " across domains" << endl;
   thread_pool.clear();
 }
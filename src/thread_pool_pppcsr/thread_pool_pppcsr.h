@@ -3,12 +3,14 @@
  * @author Christian Menges
  */
 
-#include <queue>
+#include <memory>
 #include <thread>
 #include <vector>
 
 #include "../pppcsr/PPPCSR.h"
+#include "mpscQueue.h"
 #include "task.h"
+#include "workStealingDeque.h"
 
 using namespace std;
 #ifndef PPPCSR_THREAD_POOL_H
@@ -16,30 +18,66 @@ using namespace std;
 
 class ThreadPoolPPPCSR {
  public:
-  PPPCSR *pcsr;
+  PPPCSR<void> *pcsr;
 
-  explicit ThreadPoolPPPCSR(const int NUM_OF_THREADS, bool lock_search, uint32_t init_num_nodes,
-                            int partitions_per_domain, bool use_numa);
+  explicit ThreadPoolPPPCSR(const int NUM_OF_THREADS, bool lock_search, vertex_t init_num_nodes,
+                            int partitions_per_domain, bool use_numa,
+                            MemoryBackend memory_backend = MemoryBackend::MALLOC,
+                            Partitioning partitioning = Partitioning::RANGE);
+  // bulk-loads the partitions with the given core graph
+  ThreadPoolPPPCSR(const int NUM_OF_THREADS, bool lock_search, vertex_t init_num_nodes,
+                   std::vector<PPPCSR<void>::batch_edge_t> core_graph, int partitions_per_domain, bool use_numa,
+                   MemoryBackend memory_backend = MemoryBackend::MALLOC,
+                   Partitioning partitioning = Partitioning::RANGE);
   ~ThreadPoolPPPCSR() = default;
-  /** Public API */
-  void submit_add(int thread_id, int src, int dest);     // submit task to thread {thread_id} to insert edge {src, dest}
-  void submit_delete(int thread_id, int src, int dest);  // submit task to thread {thread_id} to delete edge {src, dest}
-  void submit_read(int, int);  // submit task to thread {thread_id} to read the neighbourhood of vertex {src}
-  void start(int threads);     // start the threads
-  void stop();                 // stop the threads
+  /** Public API, any number of threads may submit while the threads run. Submitting blocks while the queue is full. */
+  void submit_add(int thread_id, vertex_t src, vertex_t dest);    // submit task to thread {thread_id} to insert edge {src, dest}
+  void submit_delete(int thread_id, vertex_t src, vertex_t dest);  // submit task to thread {thread_id} to delete edge {src, dest}
+  void submit_read(int, vertex_t);  // submit task to thread {thread_id} to read the neighbourhood of vertex {src}
+  void start(int threads);     // start the threads, they sleep while there is nothing to execute or steal
+  void stop();                 // stop the threads once they executed all submitted tasks
+  uint64_t executed_tasks() const;  // tasks executed since start(), may be called while the threads run
+  // moves the partition boundaries every interval while the threads run, off if interval is 0
+  void enable_rebalancing(chrono::milliseconds interval) { rebalance_interval = interval; }
 
  private:
+  // tasks executed and stolen by one thread
+  struct worker_stats {
+    uint64_t executed = 0;
+    uint64_t domain_steals = 0;  // from threads of the same domain
+    uint64_t remote_steals = 0;  // from threads of other domains
+  };
+
   vector<thread> thread_pool;
-  vector<queue<task>> tasks;
+  // submitted tasks of every thread
+  vector<unique_ptr<MPSCQueue<task>>> inboxes;
+  // tasks every thread moved out of its inbox, only the owner pushes and pops, idle threads steal
+  vector<WorkStealingDeque<task>> tasks;
+  vector<worker_stats> stats;
+  vector<task_progress> progress;
+  int running_threads = 0;
+  // number of threads sleeping in their inbox
+  std::atomic<unsigned> sleeping_threads{0};
   chrono::steady_clock::time_point s;
   chrono::steady_clock::time_point end;
   std::atomic_bool finished;
+  chrono::milliseconds rebalance_interval{0};
 
-  template <bool isMasterThread>
   void execute(int);
 
+  void assign_domains(int NUM_OF_THREADS);
+
+  // steals a task for thread_id, first from its own domain and then from the others; false if all queues were empty
+  bool steal(int thread_id, task &t, worker_stats &local);
+
+  // takes a task from the inbox of thread_id and moves a batch of the following ones to its deque for the thieves
+  bool refill(int thread_id, task &t);
+
+  // wakes a sleeping thread that could steal from thread_id, preferring its own domain
+  void wake_thief(int thread_id);
+
   const int available_nodes;
-  std::vector<unsigned> indeces;
+  std::vector<std::atomic<unsigned>> indeces;
   int partitions_per_domain = 1;
   std::vector<int> threadToDomain;
   std::vector<int> firstThreadDomain;
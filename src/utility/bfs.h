@@ -3,7 +3,10 @@
  * @author Christian Menges
  */
 
+#include <types.h>
+
 #include <cstdint>
+#include <limits>
 #include <queue>
 #include <vector>
 
@@ -13,24 +16,25 @@ using namespace std;
 #define PARALLEL_PACKED_CSR_BFS_H
 
 template <typename T>
-vector<uint32_t> bfs(T &graph, uint32_t start_node) {
+vector<uint32_t> bfs(T &graph, vertex_t start_node) {
   uint64_t n = graph.get_n();
   vector<uint32_t> out(n, UINT32_MAX);
-  queue<uint32_t> next;
+  queue<vertex_t> next;
   next.push(start_node);
   out[start_node] = 0;
 
   while (!next.empty()) {
-    uint32_t active = next.front();
+    vertex_t active = next.front();
     next.pop();
 
-    // get neighbors
-    for (const int neighbour : graph.get_neighbourhood(active)) {
+    // visit the neighbors in place
+    const uint32_t distance = out[active] + 1;
+    graph.for_each_neighbour(active, [&](vertex_t neighbour, typename T::value_type) {
       if (out[neighbour] == UINT32_MAX) {
         next.push(neighbour);
-        out[neighbour] = out[active] + 1;
+        out[neighbour] = distance;
       }
-    }
+    });
   }
   return out;
 }
@@ -7,58 +7,248 @@
 #define PARALLEL_PACKED_CSR_FASTLOCK_H
 
 #include <atomic>
-#include <iostream>
-#include <shared_mutex>
-#include <thread>
+#include <climits>
+#include <cstdint>
+#include <mutex>
+#include <vector>
 
-class FastLock {
-  using lock_type = std::shared_timed_mutex;
+#include "futex.h"
 
+/**
+ * Global lock of a PCSR. Readers don't lock at all, instead every thread working on the PCSR registers with the lock
+ * and calls lock_shared (or unlock_shared) at points where it doesn't touch the PCSR. A writer waits until every
+ * registered thread has arrived at such a point and parks the threads there until it is done.
+ * Every registered thread owns a slot on its own cache line, in which it flags its arrival. Waiting writers and parked
+ * threads sleep on futexes instead of spinning.
+ */
+class FastLock {
  public:
-  FastLock() : lockRequested{false}, thread_counter{0}, arrived_threads{0} {}
-
-  ~FastLock() = default;
+  FastLock() : gate{0}, writer_sleeping{0}, arrivals{0}, unregister_waiters{0}, unregistrations{0} {}
+
+  ~FastLock() {
+    SlotBlock *block = first_block.next.load();
+    while (block != nullptr) {
+      SlotBlock *next = block->next.load();
+      delete block;
+      block = next;
+    }
+  }
 
   FastLock(const FastLock &) = delete;
 
   FastLock &operator=(const FastLock &) = delete;
 
   void lock() {
-    arrived_threads.fetch_add(1);
-    mtx.lock();
-    lockRequested = true;
-    while (arrived_threads.load() < thread_counter.load()) {
-      std::this_thread::yield();
+    Slot *slot = own_slot();
+    // a registered thread waiting for another writer counts as arrived
+    if (slot != nullptr) {
+      arrive(slot);
+    }
+    writer_mutex.lock();
+    gate.fetch_add(1);
+    while (!all_arrived()) {
+      writer_sleeping.store(1);
+      const uint32_t seen = arrivals.load();
+      if (all_arrived()) {
+        break;
+      }
+      futex_wait(&arrivals, seen);
+    }
+    writer_sleeping.store(0);
+    if (slot != nullptr) {
+      slot->state.store(RUNNING);
     }
-    arrived_threads.fetch_sub(1);
   }
 
   void unlock() {
-    lockRequested.store(false);
-    mtx.unlock();
+    gate.fetch_add(1);
+    futex_wake(&gate, INT_MAX);
+    writer_mutex.unlock();
   }
 
-  void registerThread() { thread_counter.fetch_add(1); }
+  // A thread owns at most one slot per lock: registering again only nests, and the slot is freed by the matching
+  // unregisterThread. A second slot would never arrive and hold up every writer, the thread's own included.
+  void registerThread() {
+    for (registration &r : registrations()) {
+      if (r.lock == this) {
+        r.nesting++;
+        return;
+      }
+    }
+    Slot *slot = claim_slot();
+    registrations().push_back({this, slot, 1});
+  }
 
-  void unregisterThread() { thread_counter.fetch_sub(1); }
+  void unregisterThread() {
+    std::vector<registration> &regs = registrations();
+    for (auto it = regs.begin(); it != regs.end(); ++it) {
+      if (it->lock == this) {
+        if (--it->nesting > 0) {
+          return;
+        }
+        it->slot->state.store(FREE);
+        regs.erase(it);
+        // a writer might only be waiting for this thread
+        wake_writer();
+        if (unregister_waiters.load() != 0) {
+          unregistrations.fetch_add(1);
+          futex_wake(&unregistrations, INT_MAX);
+        }
+        return;
+      }
+    }
+  }
+
+  // Sleeps until no thread is registered. Threads registering meanwhile are waited for as well, so the caller has to
+  // make them back off to get through.
+  void waitUnregistered() {
+    unregister_waiters.fetch_add(1);
+    for (;;) {
+      const uint32_t seen = unregistrations.load();
+      if (registeredThreads() == 0) {
+        break;
+      }
+      futex_wait(&unregistrations, seen);
+    }
+    unregister_waiters.fetch_sub(1);
+  }
+
+  unsigned int registeredThreads() const {
+    unsigned int count = 0;
+    for (const SlotBlock *block = &first_block; block != nullptr; block = block->next.load()) {
+      for (const Slot &slot : block->slots) {
+        count += (slot.state.load() != FREE);
+      }
+    }
+    return count;
+  }
 
   void lock_shared() {
-    if (lockRequested) {
-      arrived_threads.fetch_add(1);
-      std::shared_lock<lock_type> lck(mtx);
-      arrived_threads.fetch_sub(1);
+    uint32_t g = gate.load();
+    if ((g & 1) == 0) {
+      return;
     }
+    Slot *slot = own_slot();
+    do {
+      if (slot != nullptr) {
+        arrive(slot);
+      }
+      while (gate.load() == g) {
+        futex_wait(&gate, g);
+      }
+      if (slot != nullptr) {
+        // the next writer may already have scanned the slots, so the gate is checked again after leaving
+        slot->state.store(RUNNING);
+      }
+      g = gate.load();
+    } while ((g & 1) != 0);
   }
 
   void unlock_shared() { lock_shared(); }
 
-  bool lockable() { return true; }
+  bool lockable() { return (gate.load() & 1) == 0; }
 
  private:
-  lock_type mtx;
-  std::atomic<bool> lockRequested;
-  std::atomic<unsigned int> thread_counter;
-  std::atomic<unsigned int> arrived_threads;
+  static constexpr uint32_t FREE = 0;
+  static constexpr uint32_t RUNNING = 1;  // registered and possibly working on the PCSR
+  static constexpr uint32_t ARRIVED = 2;  // registered and waiting in lock_shared or lock
+  static constexpr std::size_t SLOTS_PER_BLOCK = 64;
+
+  struct Slot {
+    std::atomic<uint32_t> state{FREE};
+    char padding[64 - sizeof(std::atomic<uint32_t>)];
+  };
+
+  struct SlotBlock {
+    Slot slots[SLOTS_PER_BLOCK];
+    std::atomic<SlotBlock *> next{nullptr};
+  };
+
+  struct registration {
+    const FastLock *lock;
+    Slot *slot;
+    unsigned nesting;  // registerThread calls not matched by unregisterThread yet
+  };
+
+  // locks the calling thread is registered with
+  static std::vector<registration> &registrations() {
+    thread_local std::vector<registration> regs;
+    return regs;
+  }
+
+  // first slot a thread tries to claim, spreads the threads over the slots of a block
+  static std::size_t slot_hint() {
+    static std::atomic<std::size_t> next_thread{0};
+    thread_local std::size_t hint = next_thread.fetch_add(1) % SLOTS_PER_BLOCK;
+    return hint;
+  }
+
+  Slot *own_slot() const {
+    for (const registration &r : registrations()) {
+      if (r.lock == this) {
+        return r.slot;
+      }
+    }
+    return nullptr;
+  }
+
+  Slot *claim_slot() {
+    const std::size_t hint = slot_hint();
+    for (SlotBlock *block = &first_block;;) {
+      for (std::size_t i = 0; i < SLOTS_PER_BLOCK; i++) {
+        Slot &slot = block->slots[(hint + i) % SLOTS_PER_BLOCK];
+        uint32_t expected = FREE;
+        if (slot.state.load(std::memory_order_relaxed) == FREE &&
+            slot.state.compare_exchange_strong(expected, RUNNING)) {
+          return &slot;
+        }
+      }
+      SlotBlock *next = block->next.load();
+      if (next == nullptr) {
+        SlotBlock *added = new SlotBlock;
+        if (block->next.compare_exchange_strong(next, added)) {
+          next = added;
+        } else {
+          delete added;
+        }
+      }
+      block = next;
+    }
+  }
+
+  void arrive(Slot *slot) {
+    slot->state.store(ARRIVED);
+    wake_writer();
+  }
+
+  void wake_writer() {
+    if (writer_sleeping.load() != 0) {
+      arrivals.fetch_add(1);
+      futex_wake(&arrivals, 1);
+    }
+  }
+
+  bool all_arrived() const {
+    for (const SlotBlock *block = &first_block; block != nullptr; block = block->next.load()) {
+      for (const Slot &slot : block->slots) {
+        if (slot.state.load() == RUNNING) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  std::mutex writer_mutex;
+  // odd while a writer holds the lock or waits for the registered threads, parked threads sleep on it
+  std::atomic<uint32_t> gate;
+  std::atomic<uint32_t> writer_sleeping;
+  // bumped when a thread arrives or unregisters while the writer sleeps, the writer sleeps on it
+  std::atomic<uint32_t> arrivals;
+  // threads in waitUnregistered, they sleep on unregistrations, which every unregistration bumps while they wait
+  std::atomic<uint32_t> unregister_waiters;
+  std::atomic<uint32_t> unregistrations;
+  SlotBlock first_block;
 };
 
 #endif  // PARALLEL_PACKED_CSR_FASTLOCK_H
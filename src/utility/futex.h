@@ -0,0 +1,30 @@
+/**
+ * @file futex.h
+ * Sleeping on and waking up 32-bit atomic words (Linux futexes)
+ */
+
+#ifndef PARALLEL_PACKED_CSR_FUTEX_H
+#define PARALLEL_PACKED_CSR_FUTEX_H
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Sleeps while word holds expected, may return spuriously
+ */
+inline void futex_wait(std::atomic<uint32_t> *word, uint32_t expected) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+/**
+ * Wakes up to count threads sleeping on word
+ */
+inline void futex_wake(std::atomic<uint32_t> *word, int count) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+#endif  // PARALLEL_PACKED_CSR_FUTEX_H
@@ -7,45 +7,129 @@
 #define PARALLEL_PACKED_CSR_HYBRIDLOCK_H
 
 #include <atomic>
-#include <shared_mutex>
+#include <cstdint>
+#include <thread>
 
+/**
+ * Leaf lock: a word-sized reader-writer spinlock with a version counter that writers bump when they changed the leaf,
+ * and a sequence number for optimistic readers that every exclusive lock and unlock bumps, so it is odd while a writer
+ * holds the lock.
+ * All three live in one 64-bit word: the number of readers in bits 0-14, a writer pending flag in bit 15, the sequence
+ * number in bits 16-39 and the version in bits 40-63. Sequence number and version wrap around, they are only ever
+ * compared for equality.
+ * While the lock is held exclusively only its holder changes the word, readers wait for an even sequence number. A
+ * writer waiting for readers to leave sets the pending flag, new readers wait until it got the lock, so that a steady
+ * stream of readers can't starve it. Readers beyond the capacity of the reader count wait as well.
+ */
 class HybridLock {
  public:
-  HybridLock() : version_counter{0} {}
+  HybridLock() : state{0} {}
   ~HybridLock() = default;
 
   HybridLock(const HybridLock &) = delete;
   HybridLock &operator=(const HybridLock &) = delete;
 
+  // only while holding the lock exclusively
   inline HybridLock &operator++() {
-    version_counter++;
+    state.store(state.load(std::memory_order_relaxed) + VERSION_ONE, std::memory_order_relaxed);
     return *this;
   }
 
+  // only while holding the lock exclusively
   inline HybridLock &operator--() {
-    version_counter--;
+    state.store(state.load(std::memory_order_relaxed) - VERSION_ONE, std::memory_order_relaxed);
     return *this;
   }
 
-  inline void lock() { mtx.lock(); }
-  inline void unlock() { mtx.unlock(); }
+  inline void lock() {
+    uint64_t s = state.load(std::memory_order_relaxed);
+    for (unsigned spins = 0;; spins++) {
+      if ((s & (WRITER | READER_MASK)) == 0) {
+        if (state.compare_exchange_weak(s, (s & ~PENDING) + SEQUENCE_ONE, std::memory_order_acquire,
+                                        std::memory_order_relaxed)) {
+          break;
+        }
+        continue;
+      }
+      // only while no writer holds the lock, its holder writes the word without atomic read-modify-writes
+      if ((s & (WRITER | PENDING)) == 0) {
+        state.compare_exchange_weak(s, s | PENDING, std::memory_order_relaxed);
+      }
+      backoff(spins);
+      s = state.load(std::memory_order_relaxed);
+    }
+    // the odd sequence number is visible before any write to the leaf
+    fence(std::memory_order_release);
+  }
+  inline void unlock() {
+    const uint64_t s = state.load(std::memory_order_relaxed);
+    // nobody else changes the word, so the sequence number can wrap around without carrying into the version
+    state.store((s & ~SEQUENCE_MASK) | ((s + SEQUENCE_ONE) & SEQUENCE_MASK), std::memory_order_release);
+  }
 
-  inline void lock_shared() { mtx.lock_shared(); }
-  inline void unlock_shared() { mtx.unlock_shared(); }
+  inline void lock_shared() {
+    uint64_t s = state.load(std::memory_order_relaxed);
+    for (unsigned spins = 0;; spins++) {
+      if ((s & (WRITER | PENDING)) == 0 && (s & READER_MASK) < READER_MASK &&
+          state.compare_exchange_weak(s, s + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+        return;
+      }
+      backoff(spins);
+      s = state.load(std::memory_order_relaxed);
+    }
+  }
+  inline void unlock_shared() { state.fetch_sub(1, std::memory_order_release); }
 
-  inline int load() const { return version_counter.load(); }
+  inline int load() const { return static_cast<int>(state.load() >> VERSION_SHIFT); }
 
-  bool lockable() {
-    auto r = mtx.try_lock();
-    if (r) {
-      mtx.unlock();
-    }
-    return r;
+  // Optimistic reads: read_begin before reading the leaf without locking it, read_end afterwards. The reads saw a
+  // consistent leaf if read_begin returned an even number and read_end returns the same one.
+  inline unsigned read_begin() const { return sequence(state.load(std::memory_order_acquire)); }
+  inline unsigned read_end() const {
+    fence(std::memory_order_acquire);
+    return sequence(state.load(std::memory_order_relaxed));
   }
 
+  bool lockable() const { return (state.load() & (WRITER | READER_MASK)) == 0; }
+
  private:
-  std::shared_timed_mutex mtx;
-  std::atomic<int> version_counter;
+  static constexpr uint64_t READER_MASK = (uint64_t(1) << 15) - 1;
+  static constexpr uint64_t PENDING = uint64_t(1) << 15;
+  static constexpr int SEQUENCE_SHIFT = 16;
+  static constexpr uint64_t SEQUENCE_ONE = uint64_t(1) << SEQUENCE_SHIFT;
+  static constexpr uint64_t SEQUENCE_MASK = ((uint64_t(1) << 24) - 1) << SEQUENCE_SHIFT;
+  // lowest bit of the sequence number
+  static constexpr uint64_t WRITER = SEQUENCE_ONE;
+  static constexpr int VERSION_SHIFT = 40;
+  static constexpr uint64_t VERSION_ONE = uint64_t(1) << VERSION_SHIFT;
+
+  static unsigned sequence(uint64_t s) { return static_cast<unsigned>((s & SEQUENCE_MASK) >> SEQUENCE_SHIFT); }
+
+  // ThreadSanitizer doesn't support fences. Its builds run on x86, where neither loads nor stores pass earlier ones of
+  // the same kind, so keeping the compiler from reordering is enough there.
+  static void fence(std::memory_order order) {
+#ifdef __SANITIZE_THREAD__
+    std::atomic_signal_fence(order);
+#else
+    std::atomic_thread_fence(order);
+#endif
+  }
+
+  static void backoff(unsigned spins) {
+    if (spins >= 16) {
+      std::this_thread::yield();
+    }
+  }
+
+  std::atomic<uint64_t> state;
 };
 
+#ifdef PPCSR_PADDED_LEAF_LOCKS
+// every lock on its own cache line, so that threads working on neighbouring leaves don't contend for the line
+struct alignas(64) PaddedHybridLock : HybridLock {};
+typedef PaddedHybridLock leaf_lock_t;
+#else
+typedef HybridLock leaf_lock_t;
+#endif
+
 #endif  // PARALLEL_PACKED_CSR_HYBRIDLOCK_H
@@ -0,0 +1,154 @@
+/**
+ * @file mpscQueue.h
+ * Bounded multi-producer single-consumer ring buffer, the task queue of a worker thread
+ */
+
+#ifndef PARALLEL_PACKED_CSR_MPSCQUEUE_H
+#define PARALLEL_PACKED_CSR_MPSCQUEUE_H
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <memory>
+
+#include "futex.h"
+
+/**
+ * Any number of producers push, one consumer pops. Every slot carries a sequence number that tells whose turn it is:
+ * slot i of round r is free for the producer of position r * capacity + i if it holds that position, and holds the item
+ * of that position once it holds the position + 1.
+ * Producers sleep while the queue is full (backpressure) and the consumer sleeps in wait() while it is empty.
+ */
+template <typename T>
+class MPSCQueue {
+ public:
+  // capacity is rounded up to a power of two
+  explicit MPSCQueue(uint64_t capacity)
+      : mask(round_up(capacity) - 1),
+        slots(new Slot[mask + 1]),
+        tail(0),
+        head(0),
+        consumer_sleeping(0),
+        space_waiters(0),
+        space_epoch(0) {
+    for (uint64_t i = 0; i <= mask; i++) {
+      slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MPSCQueue(const MPSCQueue &) = delete;
+  MPSCQueue &operator=(const MPSCQueue &) = delete;
+
+  // returns false if the queue is full
+  bool try_push(const T &item) {
+    uint64_t pos = tail.load(std::memory_order_relaxed);
+    for (;;) {
+      Slot &slot = slots[pos & mask];
+      const uint64_t seq = slot.sequence.load();
+      if (seq == pos) {
+        if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          slot.item = item;
+          // seq_cst, so that either the consumer sees the item before it sleeps or we see it sleeping
+          slot.sequence.store(pos + 1);
+          notify();
+          return true;
+        }
+      } else if (seq < pos) {
+        // the consumer hasn't freed the slot of the previous round yet
+        return false;
+      } else {
+        pos = tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // sleeps while the queue is full
+  void push(const T &item) {
+    if (try_push(item)) {
+      return;
+    }
+    space_waiters.fetch_add(1);
+    for (;;) {
+      const uint32_t epoch = space_epoch.load();
+      if (try_push(item)) {
+        break;
+      }
+      futex_wait(&space_epoch, epoch);
+    }
+    space_waiters.fetch_sub(1);
+  }
+
+  // consumer only, returns false if the queue is empty
+  bool try_pop(T &item) {
+    Slot &slot = slots[head & mask];
+    if (slot.sequence.load(std::memory_order_acquire) != head + 1) {
+      return false;
+    }
+    item = slot.item;
+    // seq_cst, so that either a waiting producer sees the free slot or we see it waiting
+    slot.sequence.store(head + mask + 1);
+    head++;
+    if (space_waiters.load() != 0) {
+      space_epoch.fetch_add(1);
+      futex_wake(&space_epoch, INT_MAX);
+    }
+    return true;
+  }
+
+  // consumer only
+  bool empty() const { return slots[head & mask].sequence.load() != head + 1; }
+
+  /**
+   * Consumer only: sleeps until an item is pushed or notify() is called, unless the queue holds items or awake()
+   * returns true. awake() is checked after the consumer announced that it sleeps, so a condition that is set before
+   * calling notify() isn't missed.
+   */
+  template <typename F>
+  void wait(F awake) {
+    consumer_sleeping.store(1);
+    if (!empty() || awake()) {
+      consumer_sleeping.store(0);
+      return;
+    }
+    while (consumer_sleeping.load() != 0) {
+      futex_wait(&consumer_sleeping, 1);
+    }
+  }
+
+  // wakes the consumer if it sleeps in wait()
+  void notify() {
+    if (consumer_sleeping.load() != 0 && consumer_sleeping.exchange(0) != 0) {
+      futex_wake(&consumer_sleeping, 1);
+    }
+  }
+
+  bool consumer_waiting() const { return consumer_sleeping.load() != 0; }
+
+ private:
+  struct Slot {
+    std::atomic<uint64_t> sequence;
+    T item;
+  };
+
+  static uint64_t round_up(uint64_t capacity) {
+    uint64_t size = 1;
+    while (size < capacity) {
+      size *= 2;
+    }
+    return size;
+  }
+
+  // producers and the consumer work on different cache lines
+  const uint64_t mask;
+  std::unique_ptr<Slot[]> slots;
+  char padding0[64];
+  std::atomic<uint64_t> tail;
+  char padding1[64];
+  uint64_t head;
+  std::atomic<uint32_t> consumer_sleeping;
+  char padding2[64];
+  std::atomic<uint32_t> space_waiters;
+  std::atomic<uint32_t> space_epoch;
+};
+
+#endif  // PARALLEL_PACKED_CSR_MPSCQUEUE_H
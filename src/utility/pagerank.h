@@ -3,6 +3,8 @@
  * @author Christian Menges
  */
 
+#include <types.h>
+
 #include <cstdint>
 #include <queue>
 #include <vector>
@@ -20,10 +22,8 @@ vector<weight_t> pagerank(T &graph, std::vector<weight_t> const &node_values) {
   for (uint64_t i = 0; i < n; i++) {
     const weight_t contrib = (node_values[i] / graph.getNode(i).num_neighbors);
 
-    // get neighbors
-    for (const int neighbour : graph.get_neighbourhood(i)) {
-      output[neighbour] += contrib;
-    }
+    // visit the neighbors in place
+    graph.for_each_neighbour(i, [&](vertex_t neighbour, typename T::value_type) { output[neighbour] += contrib; });
   }
   return output;
 }
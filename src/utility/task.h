@@ -6,12 +6,28 @@
 #ifndef PARALLEL_PACKED_CSR_TASK_H
 #define PARALLEL_PACKED_CSR_TASK_H
 
+#include <types.h>
+
+#include <atomic>
+#include <cstdint>
+
 /** Struct for tasks to the threads */
 struct task {
   bool add;    // True if this is an add task. If this is false it means it's a delete.
   bool read;   // True if this is a read task.
-  int src;     // Source vertex for this task's edge
-  int target;  // Target vertex for this task's edge
+  uint32_t partition;  // Partition of src when the task was submitted, a routing hint for the partitioned pool
+  vertex_t src;     // Source vertex for this task's edge
+  vertex_t target;  // Target vertex for this task's edge
 };
 
+// Tasks a thread executed since the pool was started, on its own cache line so that sampling it doesn't slow down the
+// neighbouring threads
+struct task_progress {
+  std::atomic<uint64_t> executed{0};
+  char padding[64 - sizeof(std::atomic<uint64_t>)];
+};
+
+// tasks a worker's queue holds, submitting to a full queue blocks until the worker caught up
+constexpr uint64_t TASK_QUEUE_CAPACITY = uint64_t(1) << 16;
+
 #endif  // PARALLEL_PACKED_CSR_TASK_H
@@ -0,0 +1,22 @@
+/**
+ * @file types.h
+ * Integer types used for vertex ids and edge array indices
+ */
+
+#ifndef PARALLEL_PACKED_CSR_TYPES_H
+#define PARALLEL_PACKED_CSR_TYPES_H
+
+#include <cstdint>
+
+// By default vertex ids and edge array indices are 32 bit wide, which limits the edge array to 2^32 slots and the
+// graph to 2^31 vertices (the top bit of a destination marks sentinels). Building with PPCSR_64BIT_IDS lifts both
+// limits at the cost of twice the memory per slot and per vertex.
+#ifdef PPCSR_64BIT_IDS
+typedef uint64_t vertex_t;  // vertex id
+typedef uint64_t index_t;   // index into the edge array
+#else
+typedef uint32_t vertex_t;  // vertex id
+typedef uint32_t index_t;   // index into the edge array
+#endif
+
+#endif  // PARALLEL_PACKED_CSR_TYPES_H
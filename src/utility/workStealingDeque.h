@@ -0,0 +1,136 @@
+/**
+ * @file workStealingDeque.h
+ * Chase-Lev work-stealing deque (Lê et al., "Correct and Efficient Work-Stealing for Weak Memory Models", PPoPP'13)
+ */
+
+#ifndef PARALLEL_PACKED_CSR_WORKSTEALINGDEQUE_H
+#define PARALLEL_PACKED_CSR_WORKSTEALINGDEQUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Deque of trivially copyable items, each stored in as many atomic words as it needs. Its owner pushes and pops at the bottom, any other thread
+ * steals from the top. Another thread may only push while the owner doesn't touch the deque, e.g. before it is started.
+ * The buffer grows on demand. Replaced buffers are kept until the deque is destroyed, thieves may still read them.
+ */
+template <typename T>
+class WorkStealingDeque {
+  static_assert(std::is_trivially_copyable<T>::value, "items are copied word by word");
+
+ public:
+  enum class Steal { SUCCESS, EMPTY, LOST_RACE };
+
+  WorkStealingDeque() : top(0), bottom(0) {
+    buffers.emplace_back(new Buffer(INITIAL_CAPACITY));
+    buffer.store(buffers.back().get());
+  }
+
+  WorkStealingDeque(const WorkStealingDeque &) = delete;
+  WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+  void push(const T &item) {
+    const int64_t b = bottom.load(std::memory_order_relaxed);
+    const int64_t t = top.load(std::memory_order_acquire);
+    Buffer *buf = buffer.load(std::memory_order_relaxed);
+    if (b - t > buf->capacity - 1) {
+      buf = grow(buf, t, b);
+    }
+    buf->put(b, item);
+    bottom.store(b + 1, std::memory_order_release);
+  }
+
+  // owner only, returns false if the deque is empty
+  bool pop(T &item) {
+    const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    Buffer *buf = buffer.load(std::memory_order_relaxed);
+    bottom.store(b, std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_seq_cst);
+    if (t > b) {
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return false;
+    }
+    item = buf->get(b);
+    if (t == b) {
+      // last item, races with the thieves
+      const bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return won;
+    }
+    return true;
+  }
+
+  Steal steal(T &item) {
+    int64_t t = top.load(std::memory_order_seq_cst);
+    const int64_t b = bottom.load(std::memory_order_seq_cst);
+    if (t >= b) {
+      return Steal::EMPTY;
+    }
+    const Buffer *buf = buffer.load(std::memory_order_acquire);
+    item = buf->get(t);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+      return Steal::LOST_RACE;
+    }
+    return Steal::SUCCESS;
+  }
+
+  // exact only while no other thread uses the deque
+  int64_t size() const {
+    return std::max<int64_t>(bottom.load(std::memory_order_relaxed) - top.load(std::memory_order_relaxed), 0);
+  }
+
+ private:
+  static constexpr int WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+  static constexpr int64_t INITIAL_CAPACITY = 1024;
+
+  // circular array, the slots are atomic words because a thief may read a slot the owner overwrites
+  struct Buffer {
+    explicit Buffer(int64_t capacity) : capacity(capacity), slots(new std::atomic<uint64_t>[capacity * WORDS]()) {}
+
+    void put(int64_t i, const T &item) {
+      uint64_t words[WORDS] = {};
+      memcpy(words, &item, sizeof(T));
+      std::atomic<uint64_t> *slot = &slots[(i & (capacity - 1)) * WORDS];
+      for (int w = 0; w < WORDS; w++) {
+        slot[w].store(words[w], std::memory_order_relaxed);
+      }
+    }
+
+    T get(int64_t i) const {
+      uint64_t words[WORDS];
+      const std::atomic<uint64_t> *slot = &slots[(i & (capacity - 1)) * WORDS];
+      for (int w = 0; w < WORDS; w++) {
+        words[w] = slot[w].load(std::memory_order_relaxed);
+      }
+      T item;
+      memcpy(&item, words, sizeof(T));
+      return item;
+    }
+
+    const int64_t capacity;  // power of two
+    std::unique_ptr<std::atomic<uint64_t>[]> slots;
+  };
+
+  Buffer *grow(Buffer *old, int64_t t, int64_t b) {
+    buffers.emplace_back(new Buffer(old->capacity * 2));
+    Buffer *grown = buffers.back().get();
+    for (int64_t i = t; i < b; i++) {
+      grown->put(i, old->get(i));
+    }
+    buffer.store(grown, std::memory_order_release);
+    return grown;
+  }
+
+  std::atomic<int64_t> top;
+  std::atomic<int64_t> bottom;
+  std::atomic<Buffer *> buffer;
+  // all buffers ever used, only the owner touches the vector
+  std::vector<std::unique_ptr<Buffer>> buffers;
+};
+
+#endif  // PARALLEL_PACKED_CSR_WORKSTEALINGDEQUE_H
@@ -5,18 +5,29 @@
 #include "DataStructureTest.h"
 #include "PPPCSR.h"
 #include "bfs.h"
+#include "edgeList.h"
+#include "leafScan.h"
 #include "pagerank.h"
+#include "updateStream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <random>
+#include <set>
 
 using ::testing::Bool;
 
 TEST_P(DataStructureTest, Initialization) {
   const int size = 10;
-  PPPCSR pcsr(size, size, GetParam(), 1, 1, false);
+  PPPCSR<uint32_t> pcsr(size, size, GetParam(), 1, 1, false);
   EXPECT_EQ(pcsr.get_n(), size);
 }
 
 TEST_P(DataStructureTest, add_node) {
-  PPPCSR pcsr(0, 0, GetParam(), 1, 1, false);
+  PPPCSR<uint32_t> pcsr(0, 0, GetParam(), 1, 1, false);
   EXPECT_EQ(pcsr.get_n(), 0);
   pcsr.add_node();
   EXPECT_EQ(pcsr.get_n(), 1);
@@ -24,7 +35,7 @@ TEST_P(DataStructureTest, add_node) {
 }
 
 TEST_P(DataStructureTest, add_edge) {
-  PPPCSR pcsr(10, 10, GetParam(), 1, 1, false);
+  PPPCSR<uint32_t> pcsr(10, 10, GetParam(), 1, 1, false);
   // Try to add edge without corresponding node
   pcsr.add_edge(11, 1, 1);
 
@@ -36,7 +47,7 @@ TEST_P(DataStructureTest, add_edge) {
 }
 
 TEST_P(DataStructureTest, remove_edge) {
-  PPPCSR pcsr(10, 10, GetParam(), 1, 1, false);
+  PPPCSR<uint32_t> pcsr(10, 10, GetParam(), 1, 1, false);
   pcsr.add_node();
   pcsr.remove_edge(0, 1);
   EXPECT_FALSE(pcsr.edge_exists(0, 1));
@@ -48,15 +59,46 @@ TEST_P(DataStructureTest, remove_edge) {
   EXPECT_EQ(pcsr.get_neighbourhood(2).size(), 0);
 }
 
+TEST_P(DataStructureTest, unweighted_add_remove_edge) {
+  PCSR<void> pcsr(100, 100, GetParam(), 0);
+  for (int i = 0; i < 1000; ++i) {
+    pcsr.add_edge(i % 100, i);
+    EXPECT_TRUE(pcsr.edge_exists(i % 100, i)) << i;
+  }
+  EXPECT_EQ(pcsr.get_neighbourhood(0).size(), 10);
+  for (int i = 0; i < 1000; i += 2) {
+    pcsr.remove_edge(i % 100, i);
+    EXPECT_FALSE(pcsr.edge_exists(i % 100, i)) << i;
+  }
+  EXPECT_EQ(pcsr.get_neighbourhood(1).size(), 10);
+  EXPECT_EQ(pcsr.get_neighbourhood(2).size(), 0);
+}
+
+TEST_P(DataStructureTest, weighted_values) {
+  PCSR<float> pcsr(10, 10, GetParam(), 0);
+  pcsr.add_edge(0, 1, 0.5f);
+  pcsr.add_edge(0, 2, 2.25f);
+  EXPECT_FLOAT_EQ(pcsr.find_value(0, 1), 0.5f);
+  EXPECT_FLOAT_EQ(pcsr.find_value(0, 2), 2.25f);
+  // Adding an existing edge updates its value
+  pcsr.add_edge(0, 1, 1.5f);
+  EXPECT_FLOAT_EQ(pcsr.find_value(0, 1), 1.5f);
+  EXPECT_EQ(pcsr.get_neighbourhood(0).size(), 2);
+
+  PCSR<uint64_t> pcsr64(10, 10, GetParam(), 0);
+  pcsr64.add_edge(3, 4, UINT64_MAX);
+  EXPECT_EQ(pcsr64.find_value(3, 4), UINT64_MAX);
+}
+
 TEST_P(DataStructureTest, add_remove_edge_1E4_seq) {
-  PCSR pcsr(10, 10, GetParam(), 0);
+  PCSR<uint32_t> pcsr(10, 10, GetParam(), 0);
   constexpr int edge_count = 1E4;
   for (int i = 1; i < edge_count + 1; ++i) {
     pcsr.add_edge(0, i, i);
     EXPECT_TRUE(pcsr.edge_exists(0, i)) << i;
     // Check whether all locks were released
     for (uint32_t j = 0; j < pcsr.edges.N / pcsr.edges.logN; ++j) {
-      EXPECT_TRUE(pcsr.edges.node_locks[j]->lockable())
+      EXPECT_TRUE(pcsr.edges.node_locks[j].lockable())
           << "Current iteration: " << i << " lock id: " << j;
     }
     EXPECT_TRUE(pcsr.edges.global_lock->lockable());
@@ -69,7 +111,7 @@ TEST_P(DataStructureTest, add_remove_edge_1E4_seq) {
     EXPECT_FALSE(pcsr.edge_exists(0, i)) << i;
     // Check whether all locks were released
     for (uint32_t j = 0; j < pcsr.edges.N / pcsr.edges.logN; ++j) {
-      EXPECT_TRUE(pcsr.edges.node_locks[j]->lockable())
+      EXPECT_TRUE(pcsr.edges.node_locks[j].lockable())
           << "Current iteration: " << i << " lock id: " << j;
     }
     EXPECT_TRUE(pcsr.edges.global_lock->lockable());
@@ -79,7 +121,7 @@ TEST_P(DataStructureTest, add_remove_edge_1E4_seq) {
 }
 
 TEST_P(DataStructureTest, add_remove_edge_1E5_par) {
-  PCSR pcsr(10, 10, GetParam(), 0);
+  PCSR<uint32_t> pcsr(10, 10, GetParam(), 0);
   constexpr int edge_count = 1E5;
 #pragma omp parallel
   {
@@ -94,7 +136,7 @@ TEST_P(DataStructureTest, add_remove_edge_1E5_par) {
 
   // Check whether all locks were released
   for (uint32_t j = 0; j < pcsr.edges.N / pcsr.edges.logN; ++j) {
-    EXPECT_TRUE(pcsr.edges.node_locks[j]->lockable()) << "Lock id: " << j;
+    EXPECT_TRUE(pcsr.edges.node_locks[j].lockable()) << "Lock id: " << j;
   }
   EXPECT_TRUE(pcsr.edges.global_lock->lockable());
   EXPECT_EQ(pcsr.get_n(), 10);
@@ -112,7 +154,7 @@ TEST_P(DataStructureTest, add_remove_edge_1E5_par) {
   }
   // Check whether all locks were released
   for (uint32_t j = 0; j < pcsr.edges.N / pcsr.edges.logN; ++j) {
-    EXPECT_TRUE(pcsr.edges.node_locks[j]->lockable()) << "Lock id: " << j;
+    EXPECT_TRUE(pcsr.edges.node_locks[j].lockable()) << "Lock id: " << j;
   }
   EXPECT_TRUE(pcsr.edges.global_lock->lockable());
   EXPECT_EQ(pcsr.get_neighbourhood(0).size(), 0);
@@ -120,7 +162,7 @@ TEST_P(DataStructureTest, add_remove_edge_1E5_par) {
 }
 
 TEST_P(DataStructureTest, add_remove_edge_random_2E4_seq) {
-  PCSR pcsr(1000, 1000, GetParam(), 0);
+  PCSR<uint32_t> pcsr(1000, 1000, GetParam(), 0);
   constexpr int edge_count = 2E4;
   for (int i = 1; i < edge_count + 1; ++i) {
     int src = std::rand() % 1000;
@@ -136,7 +178,7 @@ TEST_P(DataStructureTest, add_remove_edge_random_2E4_seq) {
     }
     // Check whether all locks were released
     for (uint32_t j = 0; j < pcsr.edges.N / pcsr.edges.logN; ++j) {
-      ASSERT_TRUE(pcsr.edges.node_locks[j]->lockable())
+      ASSERT_TRUE(pcsr.edges.node_locks[j].lockable())
           << "Current iteration: " << i << " lock id: " << j;
     }
     ASSERT_TRUE(pcsr.edges.global_lock->lockable());
@@ -144,7 +186,7 @@ TEST_P(DataStructureTest, add_remove_edge_random_2E4_seq) {
 }
 
 TEST_P(DataStructureTest, add_remove_edge_random_2E4_par) {
-  PCSR pcsr(1000, 1000, GetParam(), 0);
+  PCSR<uint32_t> pcsr(1000, 1000, GetParam(), 0);
   constexpr int edge_count = 2E5;
 #pragma omp parallel
   {
@@ -168,13 +210,468 @@ TEST_P(DataStructureTest, add_remove_edge_random_2E4_par) {
 
   // Check whether all locks were released
   for (uint32_t j = 0; j < pcsr.edges.N / pcsr.edges.logN; ++j) {
-    EXPECT_TRUE(pcsr.edges.node_locks[j]->lockable()) << "Lock id: " << j;
+    EXPECT_TRUE(pcsr.edges.node_locks[j].lockable()) << "Lock id: " << j;
   }
   EXPECT_TRUE(pcsr.edges.global_lock->lockable());
 }
 
+TEST_P(DataStructureTest, optimistic_reads_4E4_par) {
+  PCSR<uint32_t> pcsr(200, 200, GetParam(), 0);
+  // even destinations stay for good, writers only add and remove odd ones
+  for (vertex_t v = 0; v < 200; ++v) {
+    for (vertex_t d = 0; d < 40; d += 2) {
+      pcsr.add_edge(v, d, 1);
+    }
+  }
+  std::atomic<int> writers_running(2);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&pcsr, &writers_running, t] {
+      pcsr.edges.global_lock->registerThread();
+      std::mt19937 gen(t);
+      if (t < 2) {
+        for (int i = 0; i < 20000; ++i) {
+          const vertex_t src = gen() % 200;
+          const vertex_t dest = 2 * (gen() % 200) + 1;
+          if (gen() % 3 != 0) {
+            pcsr.add_edge(src, dest, i + 1);
+          } else {
+            pcsr.remove_edge(src, dest);
+          }
+        }
+        writers_running--;
+      } else {
+        // every read has to see all permanent edges in order, however the neighbourhood moves meanwhile
+        while (writers_running > 0) {
+          const vertex_t v = gen() % 200;
+          const auto neighbours = pcsr.get_neighbourhood(v);
+          EXPECT_TRUE(std::is_sorted(neighbours.begin(), neighbours.end())) << v;
+          EXPECT_EQ(std::count_if(neighbours.begin(), neighbours.end(), [](vertex_t d) { return d % 2 == 0; }), 20)
+              << v;
+          EXPECT_TRUE(pcsr.edge_exists(v, 2 * (gen() % 20))) << v;
+          pcsr.read_neighbourhood(v);
+        }
+      }
+      pcsr.edges.global_lock->unregisterThread();
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  for (uint32_t j = 0; j < pcsr.edges.N / pcsr.edges.logN; ++j) {
+    EXPECT_TRUE(pcsr.edges.node_locks[j].lockable()) << "Lock id: " << j;
+  }
+}
+
+TEST_P(DataStructureTest, occupancy_counts_2E4_par) {
+  PCSR<uint32_t> pcsr(1000, 1000, GetParam(), 0);
+  constexpr int edge_count = 2E4;
+#pragma omp parallel
+  {
+    pcsr.edges.global_lock->registerThread();
+#pragma omp for nowait
+    for (int i = 1; i < edge_count + 1; ++i) {
+      int src = std::rand() % 1000;
+      int target = std::rand() % 1000;
+      if (std::rand() % 4 != 0) {
+        pcsr.add_edge(src, target, i);
+      } else {
+        pcsr.remove_edge(src, target);
+      }
+    }
+    pcsr.edges.global_lock->unregisterThread();
+  }
+
+  expect_consistent_counts(pcsr);
+}
+
+TEST_P(DataStructureTest, add_edges_batch_2E5) {
+  PCSR<uint32_t> pcsr(1000, 1000, GetParam(), 0);
+  PPPCSR<uint32_t> pppcsr(1000, 1000, GetParam(), 1, 4, false);
+  std::map<std::pair<vertex_t, vertex_t>, uint32_t> expected;
+  // batches of growing size, with duplicates inside a batch and edges that already exist
+  for (int batch_size : {10, 1000, 50000, 150000}) {
+    std::vector<batch_edge<uint32_t>> batch;
+    for (int i = 0; i < batch_size; ++i) {
+      vertex_t src = std::rand() % 1000;
+      vertex_t target = std::rand() % 2000;
+      batch.push_back({src, target, static_cast<uint32_t>(i + 1)});
+      expected[{src, target}] = i + 1;
+    }
+    // unknown source
+    batch.push_back({1000, 0, 1});
+    pcsr.add_edges_batch(batch);
+    pppcsr.add_edges_batch(batch);
+  }
+
+  std::vector<std::vector<vertex_t>> neighbours(1000);
+  for (const auto &e : expected) {
+    neighbours[e.first.first].push_back(e.first.second);
+    ASSERT_EQ(pcsr.find_value(e.first.first, e.first.second), e.second);
+  }
+  for (vertex_t v = 0; v < 1000; ++v) {
+    ASSERT_EQ(pcsr.get_neighbourhood(v), neighbours[v]) << v;
+    ASSERT_EQ(pcsr.getNode(v).num_neighbors, neighbours[v].size()) << v;
+    ASSERT_EQ(pppcsr.get_neighbourhood(v), neighbours[v]) << v;
+  }
+  expect_consistent_counts(pcsr);
+
+  // single edge operations keep working on the merged array
+  for (vertex_t v = 0; v < 1000; ++v) {
+    pcsr.add_edge(v, 5000, 7);
+    pcsr.remove_edge(v, 5000);
+    EXPECT_FALSE(pcsr.edge_exists(v, 5000)) << v;
+  }
+}
+
+TEST_P(DataStructureTest, remove_edges_batch_2E5) {
+  PCSR<uint32_t> pcsr(1000, 1000, GetParam(), 0);
+  PPPCSR<uint32_t> pppcsr(1000, 1000, GetParam(), 1, 4, false);
+  std::set<std::pair<vertex_t, vertex_t>> expected;
+  std::vector<batch_edge<uint32_t>> insertions;
+  for (int i = 0; i < 2E5; ++i) {
+    vertex_t src = std::rand() % 1000;
+    vertex_t target = std::rand() % 2000;
+    insertions.push_back({src, target, static_cast<uint32_t>(i + 1)});
+    expected.insert({src, target});
+  }
+  pcsr.add_edges_batch(insertions);
+  pppcsr.add_edges_batch(insertions);
+  const uint64_t full_size = pcsr.edges.N;
+
+  // expire the edges in batches of growing size, with duplicates and missing edges
+  for (int batch_size : {10, 1000, 50000, 150000}) {
+    std::vector<std::pair<vertex_t, vertex_t>> batch;
+    for (int i = 0; i < batch_size; ++i) {
+      const auto &e = insertions[std::rand() % insertions.size()];
+      batch.push_back({e.src, e.dest});
+      expected.erase({e.src, e.dest});
+    }
+    batch.push_back({0, 5000});
+    batch.push_back({1000, 0});
+    pcsr.remove_edges_batch(batch);
+    pppcsr.remove_edges_batch(batch);
+  }
+
+  std::vector<std::vector<vertex_t>> neighbours(1000);
+  for (const auto &e : expected) {
+    neighbours[e.first].push_back(e.second);
+  }
+  for (vertex_t v = 0; v < 1000; ++v) {
+    ASSERT_EQ(pcsr.get_neighbourhood(v), neighbours[v]) << v;
+    ASSERT_EQ(pcsr.getNode(v).num_neighbors, neighbours[v].size()) << v;
+    ASSERT_EQ(pppcsr.get_neighbourhood(v), neighbours[v]) << v;
+  }
+  expect_consistent_counts(pcsr);
+
+  // removing everything shrinks the array
+  std::vector<std::pair<vertex_t, vertex_t>> rest(expected.begin(), expected.end());
+  pcsr.remove_edges_batch(rest);
+  EXPECT_LT(pcsr.edges.N, full_size);
+  for (vertex_t v = 0; v < 1000; ++v) {
+    ASSERT_EQ(pcsr.get_neighbourhood(v).size(), 0) << v;
+  }
+  pcsr.add_edge(999, 1, 1);
+  EXPECT_TRUE(pcsr.edge_exists(999, 1));
+}
+
+TEST_P(DataStructureTest, bulk_load_3E5) {
+  std::vector<batch_edge<uint32_t>> edge_list;
+  for (int i = 0; i < 3E5; ++i) {
+    edge_list.push_back({static_cast<vertex_t>(std::rand() % 1000), static_cast<vertex_t>(std::rand() % 2000),
+                         static_cast<uint32_t>(i + 1)});
+  }
+  // a node without edges at the end, an unknown source
+  edge_list.push_back({1001, 0, 1});
+  PCSR<uint32_t> reference(1002, 1002, GetParam(), 0);
+  for (const auto &e : edge_list) {
+    reference.add_edge(e.src, e.dest, e.value);
+  }
+
+  PCSR<uint32_t> pcsr(1002, edge_list, GetParam(), 0);
+  PPPCSR<uint32_t> pppcsr(1002, edge_list, GetParam(), 1, 4, false);
+  EXPECT_EQ(pcsr.get_n(), 1002);
+  EXPECT_EQ(pppcsr.get_n(), 1002);
+  for (vertex_t v = 0; v < 1002; ++v) {
+    const auto neighbours = reference.get_neighbourhood(v);
+    ASSERT_EQ(pcsr.get_neighbourhood(v), neighbours) << v;
+    ASSERT_EQ(pppcsr.get_neighbourhood(v), neighbours) << v;
+    ASSERT_EQ(pcsr.getNode(v).num_neighbors, neighbours.size()) << v;
+    for (vertex_t dest : neighbours) {
+      ASSERT_EQ(pcsr.find_value(v, dest), reference.find_value(v, dest)) << v << " " << dest;
+    }
+  }
+  expect_consistent_counts(pcsr);
+
+  // the loaded structure takes further updates
+  for (vertex_t v = 0; v < 1002; ++v) {
+    pcsr.add_edge(v, 5000, 1);
+    EXPECT_TRUE(pcsr.edge_exists(v, 5000)) << v;
+    pcsr.remove_edge(v, 5000);
+  }
+  pcsr.add_node();
+  pcsr.add_edge(1002, 1, 1);
+  EXPECT_TRUE(pcsr.edge_exists(1002, 1));
+
+  PCSR<void> empty(0, std::vector<batch_edge<void>>(), GetParam(), 0);
+  EXPECT_EQ(empty.get_n(), 0);
+  empty.add_node();
+  empty.add_edge(0, 3);
+  EXPECT_TRUE(empty.edge_exists(0, 3));
+}
+
+TEST_P(DataStructureTest, remove_node_clear_neighbourhood) {
+  PCSR<uint32_t> pcsr(200, 200, GetParam(), 0);
+  PPPCSR<uint32_t> pppcsr(200, 200, GetParam(), 1, 4, false);
+  std::set<std::pair<vertex_t, vertex_t>> expected;
+  // node 7 gets a large neighbourhood, node 42 many incoming edges
+  for (int i = 0; i < 20000; ++i) {
+    vertex_t src = (i % 3 == 0) ? 7 : std::rand() % 200;
+    vertex_t target = (i % 5 == 0) ? 42 : std::rand() % 200;
+    pcsr.add_edge(src, target, i);
+    pppcsr.add_edge(src, target, i);
+    expected.insert({src, target});
+  }
+
+  pcsr.clear_neighbourhood(7);
+  pppcsr.clear_neighbourhood(7);
+  pcsr.remove_node(42);
+  pppcsr.remove_node(42);
+  for (auto it = expected.begin(); it != expected.end();) {
+    it = (it->first == 7 || it->first == 42 || it->second == 42) ? expected.erase(it) : std::next(it);
+  }
+
+  std::vector<std::vector<vertex_t>> neighbours(200);
+  for (const auto &e : expected) {
+    neighbours[e.first].push_back(e.second);
+  }
+  for (vertex_t v = 0; v < 200; ++v) {
+    ASSERT_EQ(pcsr.get_neighbourhood(v), neighbours[v]) << v;
+    if (v == 7 || v == 42) {
+      ASSERT_EQ(pcsr.getNode(v).num_neighbors, 0) << v;
+    }
+    ASSERT_EQ(pppcsr.get_neighbourhood(v), neighbours[v]) << v;
+  }
+  expect_consistent_counts(pcsr);
+
+  // the id of the removed node is handed out again
+  EXPECT_EQ(pcsr.add_node(), 42);
+  EXPECT_EQ(pcsr.add_node(), 200);
+  EXPECT_EQ(pppcsr.add_node(), 42);
+  EXPECT_EQ(pcsr.get_n(), 201);
+  pcsr.add_edge(42, 3, 1);
+  pcsr.add_edge(7, 42, 1);
+  EXPECT_TRUE(pcsr.edge_exists(42, 3));
+  EXPECT_TRUE(pcsr.edge_exists(7, 42));
+  EXPECT_EQ(pcsr.get_neighbourhood(42).size(), 1);
+}
+
+TEST_P(DataStructureTest, migrate_nodes_and_edges) {
+  PCSR<uint32_t> a(300, 300, GetParam(), 0);
+  PCSR<uint32_t> b(100, 100, GetParam(), 0);
+  std::vector<std::map<vertex_t, uint32_t>> expected_a(300), expected_b(100);
+  for (uint32_t i = 0; i < 30000; ++i) {
+    vertex_t src = std::rand() % 300;
+    vertex_t target = std::rand() % 300;
+    a.add_edge(src, target, i);
+    expected_a[src][target] = i;
+    if (i % 3 == 0) {
+      b.add_edge(src % 100, target, i);
+      expected_b[src % 100][target] = i;
+    }
+  }
+  const index_t degree_299 = a.getNode(299).num_neighbors;
+
+  // the last 120 nodes of a move to the front of b, then the first 50 to the back of b
+  auto back = a.remove_nodes_and_edges_back(120);
+  ASSERT_EQ(back.first.size(), 120);
+  EXPECT_EQ(back.first.back().num_neighbors, degree_299);
+  b.insert_nodes_and_edges_front(back.first, back.second);
+  auto front = a.remove_nodes_and_edges_front(50);
+  ASSERT_EQ(front.first.size(), 50);
+  b.insert_nodes_and_edges_back(front.first, front.second);
+
+  std::vector<std::map<vertex_t, uint32_t>> now_a(expected_a.begin() + 50, expected_a.begin() + 180);
+  std::vector<std::map<vertex_t, uint32_t>> now_b(expected_a.begin() + 180, expected_a.end());
+  now_b.insert(now_b.end(), expected_b.begin(), expected_b.end());
+  now_b.insert(now_b.end(), expected_a.begin(), expected_a.begin() + 50);
+  ASSERT_EQ(a.get_n(), now_a.size());
+  ASSERT_EQ(b.get_n(), now_b.size());
+  EXPECT_EQ(b.getNode(119).num_neighbors, degree_299);
+
+  for (PCSR<uint32_t> *pcsr : {&a, &b}) {
+    const auto &expected = (pcsr == &a) ? now_a : now_b;
+    for (vertex_t v = 0; v < expected.size(); ++v) {
+      std::vector<vertex_t> neighbours;
+      for (const auto &e : expected[v]) {
+        neighbours.push_back(e.first);
+        ASSERT_EQ(pcsr->find_value(v, e.first), e.second) << v << " " << e.first;
+      }
+      ASSERT_EQ(pcsr->get_neighbourhood(v), neighbours) << v;
+    }
+    expect_consistent_counts(*pcsr);
+  }
+
+  // both ends keep working after the migration
+  b.add_edge(0, 7, 1);
+  b.add_edge(now_b.size() - 1, 7, 2);
+  b.remove_edge(now_b.size() - 1, 7);
+  a.add_edge(now_a.size() - 1, 3, 3);
+  EXPECT_TRUE(b.edge_exists(0, 7));
+  EXPECT_FALSE(b.edge_exists(now_b.size() - 1, 7));
+  EXPECT_TRUE(a.edge_exists(now_a.size() - 1, 3));
+  EXPECT_EQ(a.add_node(), now_a.size());
+
+  // a partition can be emptied completely
+  auto all = a.remove_nodes_and_edges_front(a.get_n());
+  EXPECT_EQ(all.first.size(), now_a.size() + 1);
+  EXPECT_EQ(a.get_n(), 0);
+  a.insert_nodes_and_edges_back(all.first, all.second);
+  EXPECT_TRUE(a.edge_exists(now_a.size() - 1, 3));
+}
+
+TEST_P(DataStructureTest, rebalance_skewed_8E4_par) {
+  PPPCSR<uint32_t> pppcsr(4000, 4000, GetParam(), 1, 4, false);
+  // nearly all updates go to the last tenth of the ids, which starts out in the last partition
+  ASSERT_EQ(pppcsr.get_partiton(3600), 3);
+  constexpr int threads = 4;
+  std::vector<std::set<std::pair<vertex_t, vertex_t>>> expected(threads);
+  std::vector<std::thread> workers;
+  pppcsr.start_rebalancer(std::chrono::milliseconds(1));
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&pppcsr, &expected, t] {
+      std::mt19937 gen(t);
+      for (int i = 0; i < 20000; ++i) {
+        vertex_t src = (i % 10 == 0) ? gen() % 4000 : 3600 + gen() % 400;
+        // every thread owns the destinations congruent to its id, so the outcome doesn't depend on the interleaving
+        vertex_t target = (gen() % 1000) * threads + t;
+        pppcsr.add_edge(src, target, i);
+        expected[t].insert({src, target});
+        if (i % 4 == 3) {
+          auto victim = std::next(expected[t].begin(), gen() % expected[t].size());
+          pppcsr.remove_edge(victim->first, victim->second);
+          expected[t].erase(victim);
+        }
+      }
+    });
+  }
+  for (auto &w : workers) {
+    w.join();
+  }
+  pppcsr.stop_rebalancer();
+  for (int round = 0; round < 10 && pppcsr.rebalance(); ++round) {
+  }
+
+  EXPECT_LT(pppcsr.get_partiton(3600), 3);
+  EXPECT_EQ(pppcsr.get_n(), 4000);
+  std::vector<std::vector<vertex_t>> neighbours(4000);
+  for (const auto &thread_edges : expected) {
+    for (const auto &e : thread_edges) {
+      neighbours[e.first].push_back(e.second);
+    }
+  }
+  for (vertex_t v = 0; v < 4000; ++v) {
+    std::sort(neighbours[v].begin(), neighbours[v].end());
+    ASSERT_EQ(pppcsr.get_neighbourhood(v), neighbours[v]) << v;
+  }
+}
+
+TEST_P(DataStructureTest, partition_lookup) {
+  PPPCSR<uint32_t> pppcsr(1000, 1000, GetParam(), 1, 16, false);
+  // 15 partitions of 62 vertices, the last one takes the remaining 70 and every node added later
+  for (vertex_t v = 0; v < 1100; ++v) {
+    ASSERT_EQ(pppcsr.get_partiton(v), std::min<vertex_t>(v / 62, 15)) << v;
+  }
+
+  // edges on the last 70 vertices only, the rebalancer moves boundaries and lookups switch to the search
+  for (vertex_t v = 930; v < 1000; ++v) {
+    for (vertex_t d = 0; d < 40; ++d) {
+      pppcsr.add_edge(v, d, 1);
+    }
+  }
+  ASSERT_TRUE(pppcsr.rebalance());
+  EXPECT_LT(pppcsr.get_partiton(930), 15);
+  EXPECT_EQ(pppcsr.get_partiton(0), 0);
+  EXPECT_EQ(pppcsr.get_partiton(999), 15);
+  EXPECT_EQ(pppcsr.get_partiton(5000), 15);
+  for (vertex_t v = 1; v < 1000; ++v) {
+    const std::size_t p = pppcsr.get_partiton(v);
+    ASSERT_GE(p, pppcsr.get_partiton(v - 1)) << v;
+    // a stale hint is corrected, a right one is used
+    pppcsr.add_edge(v, 999, 2, (p + 1) % 16);
+    pppcsr.read_neighbourhood(v, p);
+    EXPECT_TRUE(pppcsr.edge_exists(v, 999)) << v;
+  }
+  EXPECT_EQ(pppcsr.get_neighbourhood(950).size(), 41);
+}
+
+TEST_P(DataStructureTest, partitioning_strategies) {
+  // vertices 0-99 have 50 edges each, the other 900 none
+  std::vector<batch_edge<uint32_t>> edge_list;
+  for (vertex_t v = 0; v < 100; ++v) {
+    for (vertex_t d = 0; d < 50; ++d) {
+      edge_list.push_back({v, (v * 7 + d * 13) % 1000, static_cast<uint32_t>(d + 1)});
+    }
+  }
+  PCSR<uint32_t> reference(1000, edge_list, GetParam(), 0);
+  for (Partitioning partitioning : {Partitioning::RANGE, Partitioning::HASH, Partitioning::DEGREE}) {
+    SCOPED_TRACE(partitioning_name(partitioning));
+    PPPCSR<uint32_t> pppcsr(1000, edge_list, GetParam(), 1, 4, false, MemoryBackend::MALLOC, partitioning);
+    if (partitioning == Partitioning::HASH) {
+      EXPECT_EQ(pppcsr.get_partiton(998), 2);
+      EXPECT_EQ(pppcsr.get_partiton(999), 3);
+      EXPECT_FALSE(pppcsr.rebalance());
+    } else if (partitioning == Partitioning::DEGREE) {
+      // 6000 elements in total, a vertex with edges weighs 51
+      EXPECT_EQ(pppcsr.get_partiton(29), 0);
+      EXPECT_EQ(pppcsr.get_partiton(30), 1);
+      EXPECT_EQ(pppcsr.get_partiton(88), 2);
+      EXPECT_EQ(pppcsr.get_partiton(89), 3);
+    }
+    for (vertex_t v = 0; v < 1000; ++v) {
+      ASSERT_EQ(pppcsr.get_neighbourhood(v), reference.get_neighbourhood(v)) << v;
+    }
+    EXPECT_EQ(bfs(pppcsr, 0), bfs(reference, 0));
+
+    // added nodes continue the ids whichever partition they land in, removed ids are handed out again
+    EXPECT_EQ(pppcsr.add_node(), 1000);
+    EXPECT_EQ(pppcsr.add_node(), 1001);
+    pppcsr.add_edge(1001, 5, 1);
+    pppcsr.add_edge(5, 1001, 1);
+    EXPECT_TRUE(pppcsr.edge_exists(1001, 5));
+    pppcsr.remove_node(1001);
+    EXPECT_FALSE(pppcsr.edge_exists(5, 1001));
+    EXPECT_EQ(pppcsr.add_node(), 1001);
+    EXPECT_EQ(pppcsr.get_n(), 1002);
+    EXPECT_TRUE(pppcsr.get_neighbourhood(1001).empty());
+  }
+}
+
+TEST_P(DataStructureTest, for_each_neighbour) {
+  PCSR<uint32_t> pcsr(300, 300, GetParam(), 0);
+  PPPCSR<uint32_t> pppcsr(300, 300, GetParam(), 1, 4, false);
+  for (int i = 0; i < 5000; ++i) {
+    const vertex_t src = std::rand() % 300;
+    const vertex_t dest = std::rand() % 300;
+    pcsr.add_edge(src, dest, i + 1);
+    pppcsr.add_edge(src, dest, i + 1);
+  }
+  for (vertex_t v = 0; v < 300; ++v) {
+    std::vector<vertex_t> pcsr_neighbours, pppcsr_neighbours;
+    pcsr.for_each_neighbour(v, [&](vertex_t dest, uint32_t value) {
+      pcsr_neighbours.push_back(dest);
+      EXPECT_EQ(value, pcsr.find_value(v, dest));
+    });
+    pppcsr.for_each_neighbour(v, [&](vertex_t dest, uint32_t) { pppcsr_neighbours.push_back(dest); });
+    ASSERT_EQ(pcsr_neighbours, pcsr.get_neighbourhood(v)) << v;
+    ASSERT_EQ(pppcsr_neighbours, pcsr_neighbours) << v;
+  }
+  // unknown nodes have no neighbours
+  pcsr.for_each_neighbour(300, [](vertex_t, uint32_t) { FAIL(); });
+}
+
 TEST_P(DataStructureTest, bfs_5E4) {
-  PCSR pcsr(1000, 1000, GetParam(), 0);
+  PCSR<uint32_t> pcsr(1000, 1000, GetParam(), 0);
   constexpr int edge_count = 5E4;
   for (int i = 1; i < edge_count + 1; ++i) {
     int src = std::rand() % 1000;
@@ -193,7 +690,7 @@ TEST_P(DataStructureTest, bfs_5E4) {
 }
 
 TEST_P(DataStructureTest, pagerank_5E4) {
-  PCSR pcsr(1000, 1000, GetParam(), 0);
+  PCSR<uint32_t> pcsr(1000, 1000, GetParam(), 0);
   constexpr int edge_count = 5E4;
   for (int i = 1; i < edge_count + 1; ++i) {
     int src = std::rand() % 1000;
@@ -212,4 +709,256 @@ TEST_P(DataStructureTest, pagerank_5E4) {
        << endl;
 }
 
-INSTANTIATE_TEST_CASE_P(DataStructureTestSuite, DataStructureTest, Bool());
\ No newline at end of file
+TEST_P(DataStructureTest, huge_page_backends_3E5_seq) {
+  // grows the edge array from heap memory into huge pages and back
+  for (MemoryBackend backend : {MemoryBackend::TRANSPARENT_HUGE_PAGES, MemoryBackend::EXPLICIT_HUGE_PAGES}) {
+    PCSR<double> pcsr(100, 100, GetParam(), 0, backend);
+    constexpr int edge_count = 3E5;
+    for (int i = 0; i < edge_count; ++i) {
+      pcsr.add_edge(i % 100, i, i);
+    }
+    EXPECT_GE(pcsr.edges.N * sizeof(vertex_t), size_t(2) << 20) << memory_backend_name(backend);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(pcsr.edges.dests) % (size_t(2) << 20), 0) << memory_backend_name(backend);
+    for (int i = 0; i < edge_count; ++i) {
+      ASSERT_DOUBLE_EQ(pcsr.find_value(i % 100, i), i) << memory_backend_name(backend) << " " << i;
+    }
+    for (int i = 0; i < edge_count; ++i) {
+      pcsr.remove_edge(i % 100, i);
+    }
+    for (int i = 0; i < 100; ++i) {
+      EXPECT_EQ(pcsr.get_neighbourhood(i).size(), 0) << memory_backend_name(backend) << " " << i;
+    }
+  }
+}
+
+TEST(LeafScanTest, scan_leaf) {
+  cout << "Leaf scan: " << scan_leaf_isa() << endl;
+  vector<vertex_t> leaf(LEAF_SCAN_MAX_LEN);
+  for (size_t len = 0; len <= LEAF_SCAN_MAX_LEN; ++len) {
+    for (int round = 0; round < 20; ++round) {
+      // sorted destinations with empty slots in between
+      vertex_t dest = 0;
+      for (size_t i = 0; i < len; ++i) {
+        if (std::rand() % 3 == 0) {
+          leaf[i] = NULL_DEST;
+        } else {
+          dest += std::rand() % 4;
+          leaf[i] = dest;
+        }
+      }
+      const vertex_t key = std::rand() % (dest + 2);
+      uint64_t occupied = 0;
+      uint64_t less = 0;
+      for (size_t i = 0; i < len; ++i) {
+        occupied |= uint64_t(!is_null(leaf[i])) << i;
+        less |= uint64_t(!is_null(leaf[i]) && leaf[i] < key) << i;
+      }
+      const leaf_masks m = scan_leaf(leaf.data(), len, key);
+      ASSERT_EQ(m.occupied, occupied) << "len: " << len << " key: " << key;
+      ASSERT_EQ(m.less, less) << "len: " << len << " key: " << key;
+    }
+  }
+}
+
+TEST(LeafLockTest, hybrid_lock) {
+  EXPECT_EQ(sizeof(HybridLock), 8);
+  EXPECT_EQ(sizeof(leaf_lock_t) % 8, 0);
+  HybridLock lock;
+  EXPECT_EQ(lock.read_begin() % 2, 0);
+  lock.lock_shared();
+  lock.lock_shared();
+  EXPECT_FALSE(lock.lockable());
+  EXPECT_EQ(lock.read_begin() % 2, 0);
+  lock.unlock_shared();
+  lock.unlock_shared();
+  EXPECT_TRUE(lock.lockable());
+
+  // 2^24 exclusive sections wrap the sequence number around, which must not change the version
+  const unsigned seq = lock.read_begin();
+  for (int i = 0; i < (1 << 23); ++i) {
+    lock.lock();
+    ASSERT_EQ(lock.read_begin() % 2, 1);
+    lock.unlock();
+  }
+  EXPECT_EQ(lock.read_end(), seq);
+  EXPECT_EQ(lock.load(), 0);
+  lock.lock();
+  ++lock;
+  ++lock;
+  --lock;
+  lock.unlock();
+  EXPECT_EQ(lock.load(), 1);
+  EXPECT_TRUE(lock.lockable());
+
+  // a writer waits for the readers to leave, and new readers wait for the writer
+  std::atomic<bool> written(false);
+  std::atomic<bool> read(false);
+  lock.lock_shared();
+  std::thread writer([&lock, &written] {
+    lock.lock();
+    written = true;
+    lock.unlock();
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  std::thread reader([&lock, &read, &written] {
+    lock.lock_shared();
+    EXPECT_TRUE(written);
+    read = true;
+    lock.unlock_shared();
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_FALSE(written);
+  EXPECT_FALSE(read);
+  lock.unlock_shared();
+  writer.join();
+  reader.join();
+  EXPECT_TRUE(written);
+  EXPECT_TRUE(read);
+  EXPECT_TRUE(lock.lockable());
+}
+
+TEST(GlobalLockTest, fast_lock) {
+  FastLock lock;
+  EXPECT_EQ(lock.registeredThreads(), 0);
+  // without registered threads the writer doesn't wait
+  lock.lock();
+  EXPECT_FALSE(lock.lockable());
+  lock.unlock();
+  EXPECT_TRUE(lock.lockable());
+
+  // nested registrations share a slot, so the registered thread's own writes don't wait for it
+  lock.registerThread();
+  lock.registerThread();
+  EXPECT_EQ(lock.registeredThreads(), 1);
+  lock.lock();
+  lock.unlock();
+  lock.unregisterThread();
+  EXPECT_EQ(lock.registeredThreads(), 1);
+  lock.unregisterThread();
+  EXPECT_EQ(lock.registeredThreads(), 0);
+
+  // waitUnregistered sleeps until the last registered thread leaves
+  std::atomic<bool> registered(false);
+  std::atomic<bool> left(false);
+  std::thread leaving([&] {
+    lock.registerThread();
+    registered = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    left = true;
+    lock.unregisterThread();
+  });
+  while (!registered) {
+    std::this_thread::yield();
+  }
+  lock.waitUnregistered();
+  EXPECT_TRUE(left);
+  leaving.join();
+
+  // 100 registered workers, more than fit into one block of slots, count shared increments between safe points
+  const int workers = 100;
+  std::atomic<bool> stop(false);
+  std::atomic<int> started(0);
+  std::atomic<int> in_section(0);
+  std::atomic<int> violations(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < workers; ++t) {
+    threads.emplace_back([&] {
+      lock.registerThread();
+      started++;
+      while (!stop) {
+        lock.lock_shared();
+        in_section++;
+        std::this_thread::yield();
+        in_section--;
+        lock.unlock_shared();
+      }
+      lock.unregisterThread();
+    });
+  }
+  while (started < workers) {
+    std::this_thread::yield();
+  }
+  EXPECT_EQ(lock.registeredThreads(), workers);
+  for (int round = 0; round < 20; ++round) {
+    lock.lock();
+    // every worker is parked at a safe point
+    if (in_section != 0) {
+      violations++;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    if (in_section != 0) {
+      violations++;
+    }
+    lock.unlock();
+  }
+  stop = true;
+  for (std::thread &t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(violations, 0);
+  EXPECT_EQ(lock.registeredThreads(), 0);
+  EXPECT_TRUE(lock.lockable());
+}
+
+TEST(UpdateStreamTest, chunked_parsing) {
+  // lines longer than the chunks, an operation column, a CRLF line, an invalid line and no final line break
+  const std::string path = "update_stream_test.txt";
+  {
+    std::ofstream f(path);
+    f << "1 2\n"
+      << "123456 7654321 0\n"
+      << "\n"
+      << "3\t4 1\r\n"
+      << "5 x\n"
+      << "99999999999999999999 1\n"
+      << "8,9";
+  }
+  std::vector<std::string> invalid;
+  std::vector<update> updates;
+  ChunkReader reader(path, 7);
+  std::string chunk;
+  while (reader.next(chunk)) {
+    ASSERT_FALSE(chunk.empty());
+    EXPECT_EQ(chunk.back(), '\n');
+    parse_updates(
+        chunk.data(), chunk.data() + chunk.size(), Operation::ADD, [&](const update &u) { updates.push_back(u); },
+        [&](const std::string &line) { invalid.push_back(line); });
+  }
+  std::remove(path.c_str());
+
+  ASSERT_EQ(updates.size(), 4);
+  EXPECT_TRUE(updates[0].op == Operation::ADD && updates[0].src == 1 && updates[0].dest == 2);
+  EXPECT_TRUE(updates[1].op == Operation::DELETE && updates[1].src == 123456 && updates[1].dest == 7654321);
+  EXPECT_TRUE(updates[2].op == Operation::ADD && updates[2].src == 3 && updates[2].dest == 4);
+  EXPECT_TRUE(updates[3].op == Operation::ADD && updates[3].src == 8 && updates[3].dest == 9);
+  EXPECT_EQ(invalid, (std::vector<std::string>{"5 x", "99999999999999999999 1"}));
+}
+
+TEST(UpdateStreamTest, parallel_edge_list_1E5) {
+  // large enough to be split between the threads, without a final line break
+  const std::string path = "edge_list_test.txt";
+  const int lines = 100000;
+  {
+    std::ofstream f(path);
+    for (int i = 0; i < lines; i++) {
+      f << (i != 0 ? "\n" : "") << i << " " << (i * 7) % lines << (i % 3 == 0 ? " 0" : "");
+    }
+  }
+  update_list edges = read_edge_list(path, Operation::ADD, 4);
+  std::remove(path.c_str());
+
+  EXPECT_GT(edges.parts.size(), 1);
+  EXPECT_EQ(edges.size(), lines);
+  EXPECT_EQ(edges.invalid, 0);
+  EXPECT_EQ(edges.max_id, lines - 1);
+  vertex_t i = 0;
+  edges.for_each([&](const update &u) {
+    EXPECT_EQ(u.src, i);
+    EXPECT_EQ(u.dest, (i * 7) % lines);
+    EXPECT_TRUE(u.op == (i % 3 == 0 ? Operation::DELETE : Operation::ADD));
+    i++;
+  });
+  EXPECT_EQ(i, lines);
+}
+
+INSTANTIATE_TEST_CASE_P(DataStructureTestSuite, DataStructureTest, Bool());
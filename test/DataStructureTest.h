@@ -8,6 +8,24 @@
 
 #include <gtest/gtest.h>
 
+#include "PCSR.h"
+
 class DataStructureTest : public testing::TestWithParam<bool> {};
 
+// Every leaf count matches the slots and every inner node the sum of its children
+template <typename value_t>
+void expect_consistent_counts(const PCSR<value_t> &pcsr) {
+  const uint64_t leaves = pcsr.edges.N / pcsr.edges.logN;
+  for (uint64_t leaf = 0; leaf < leaves; ++leaf) {
+    index_t occupied = 0;
+    for (uint64_t i = leaf * pcsr.edges.logN; i < (leaf + 1) * pcsr.edges.logN; ++i) {
+      occupied += !is_null(pcsr.edges.dests[i]);
+    }
+    ASSERT_EQ(pcsr.edges.counts[leaves + leaf], occupied) << "Leaf: " << leaf;
+  }
+  for (uint64_t k = 1; k < leaves; ++k) {
+    ASSERT_EQ(pcsr.edges.counts[k], pcsr.edges.counts[2 * k] + pcsr.edges.counts[2 * k + 1]) << "Node: " << k;
+  }
+}
+
 #endif // PARALLEL_PACKED_CSR_DATASTRUCTURETEST_H
@@ -3,10 +3,16 @@
  * @author Christian Menges
  */
 
+#include <atomic>
 #include <map>
 #include <numeric>
+#include <thread>
 
 #include "SchedulerTest.h"
+#include "mpscQueue.h"
+#include "task.h"
+#include "thread_pool_pppcsr.h"
+#include "workStealingDeque.h"
 
 TEST_F(SchedulerTest, lookupTableCreation) {
   for (int d = 1; d <= 8; ++d) {
@@ -56,4 +62,101 @@ TEST_F(SchedulerTest, lookupTableCreation) {
       ASSERT_GE(2, differentDomainSizes.size());
     }
   }
-}
\ No newline at end of file
+}
+
+TEST(WorkStealingDequeTest, steal_1E5) {
+  WorkStealingDeque<task> deque;
+  const vertex_t n = 100000;
+  std::vector<std::atomic<int>> taken(n);
+  for (auto &count : taken) {
+    count = 0;
+  }
+  std::atomic<bool> done(false);
+  std::atomic<uint64_t> stolen(0);
+  std::vector<std::thread> thieves;
+  for (int i = 0; i < 3; ++i) {
+    thieves.emplace_back([&] {
+      task t;
+      while (!done || deque.size() > 0) {
+        if (deque.steal(t) == WorkStealingDeque<task>::Steal::SUCCESS) {
+          taken[t.src]++;
+          stolen++;
+        }
+      }
+    });
+  }
+  // the owner pushes in bursts, which grows the buffer, and pops every other task
+  task t;
+  for (vertex_t i = 0; i < n; ++i) {
+    deque.push(task{true, false, 0, i, i});
+    if (i % 2 == 0 && deque.pop(t)) {
+      taken[t.src]++;
+    }
+    if (i % 5000 == 0) {
+      std::this_thread::yield();
+    }
+  }
+  while (deque.pop(t)) {
+    taken[t.src]++;
+  }
+  done = true;
+  for (std::thread &thief : thieves) {
+    thief.join();
+  }
+  for (vertex_t i = 0; i < n; ++i) {
+    ASSERT_EQ(taken[i], 1) << "task " << i;
+  }
+  cout << "Stolen: " << stolen << endl;
+}
+
+TEST(MPSCQueueTest, producers_1E5) {
+  // a small queue, so that the producers have to wait for the consumer
+  MPSCQueue<task> queue(64);
+  const int producers = 4;
+  const vertex_t per_producer = 25000;
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; ++p) {
+    threads.emplace_back([&queue, p] {
+      for (vertex_t i = 0; i < per_producer; ++i) {
+        queue.push(task{true, false, static_cast<uint32_t>(p), i, i});
+      }
+    });
+  }
+  std::vector<vertex_t> next(producers, 0);
+  task t;
+  for (vertex_t popped = 0; popped < producers * per_producer;) {
+    if (!queue.try_pop(t)) {
+      queue.wait([] { return false; });
+      continue;
+    }
+    // every producer's tasks arrive in order
+    ASSERT_EQ(t.src, next[t.partition]++);
+    popped++;
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  EXPECT_TRUE(queue.empty());
+  EXPECT_FALSE(queue.try_pop(t));
+}
+
+TEST(ThreadPoolTest, concurrent_submission_4E4) {
+  // four producers submit while the worker runs
+  ThreadPoolPPPCSR pool(1, false, 1000, 2, false);
+  pool.start(1);
+  std::vector<std::thread> producers;
+  for (int p = 0; p < 4; ++p) {
+    producers.emplace_back([&pool, p] {
+      for (vertex_t i = 0; i < 10000; ++i) {
+        pool.submit_add(0, (p * 10000 + i) % 1000, p * 10000 + i);
+      }
+    });
+  }
+  for (std::thread &producer : producers) {
+    producer.join();
+  }
+  pool.stop();
+  for (vertex_t e = 0; e < 40000; ++e) {
+    ASSERT_TRUE(pool.pcsr->edge_exists(e % 1000, e)) << e;
+  }
+}